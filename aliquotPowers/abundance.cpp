@@ -0,0 +1,83 @@
+/* Abundance of a partial factorization for the aliquot power tools.
+ *
+ * (C) Alexander Jones, 2021. My own code is under the MIT License, which is
+ * included in this repository.
+ */
+
+#include "abundance.h"
+
+#include <cfloat>
+
+// Primes this large contribute less than 2^-1000 to the sum, well inside TINY_TERM
+#define MAX_DOUBLE_BITS 1000
+#define TINY_TERM 1e-290
+
+// log(sigma(p^k) / p^k) = log1p(-x^(k+1)) - log1p(-x) for x = 1/p. Given x within 2 ulps of 1/p, x^(k+1) is
+// within (2k+3) ulps of p^-(k+1), and log1p(-x) has slope at most 2 for x <= 1/2, so each logarithm is within
+// 16(k+2) ulps of its true value even allowing for log1p's own error; the sum adds one rounding per term.
+void AbundanceBound::addReciprocal(double x, uint64_t multiplicity) {
+    double a = log1p(-x);
+    double b = log1p(-pow(x, (double) multiplicity + 1));
+    logSum += b - a;
+    error += 16 * DBL_EPSILON * (-a - ((double) multiplicity + 2) * b) + DBL_MIN + DBL_EPSILON * logSum;
+}
+
+void AbundanceBound::add(uint64_t prime, uint64_t multiplicity) {
+    addReciprocal(1 / (double) prime, multiplicity);
+}
+
+void AbundanceBound::add(const mpz_class & prime, uint64_t multiplicity) {
+    if (mpz_sizeinbase(prime.get_mpz_t(), 2) > MAX_DOUBLE_BITS) {
+        error += TINY_TERM;
+        return;
+    }
+    addReciprocal(1 / prime.get_d(), multiplicity);
+}
+
+void AbundanceBound::add(const FactorList & factors) {
+    for (size_t i = 0; i < factors.size(); i++) {
+        if (factors.isWord(i)) {
+            add(factors.word(i), factors.multiplicity(i));
+        } else {
+            add(factors.prime(i), factors.multiplicity(i));
+        }
+    }
+}
+
+int AbundanceBound::decide() const {
+    // log(2.0) is within half an ulp of log 2
+    double threshold = log(2.0);
+    if (logSum - error > threshold + DBL_EPSILON) {
+        return 1;
+    }
+    if (logSum + error < threshold - DBL_EPSILON) {
+        return -1;
+    }
+    return 0;
+}
+
+bool exactlyAbundant(const FactorList & factors) {
+    mpz_class s = 1, n = 2, power;
+    for (size_t i = 0; i < factors.size(); i++) {
+        factors.primePower(i, power);
+        n *= power;
+        if (factors.isWord(i)) {
+            n *= factors.word(i) - 1;
+            power *= factors.word(i);
+        } else {
+            mpz_class p = factors.prime(i);
+            n *= p - 1;
+            power *= p;
+        }
+        s *= power - 1;
+    }
+    return s > n;
+}
+
+bool isAbundant(const FactorList & factors, double & abundance) {
+    AbundanceBound bound;
+    bound.add(factors);
+    abundance = bound.abundance();
+    int decision = bound.decide();
+    return decision ? decision > 0 : exactlyAbundant(factors);
+}
@@ -0,0 +1,53 @@
+/* Abundance of a partial factorization for the aliquot power tools.
+ *
+ * A divisor d = product(p^k) makes index 1 abundant when sigma(d) > 2d, that
+ * is when the product of sigma(p^k) / p^k = (1 - p^-(k+1)) / (1 - 1/p) exceeds
+ * 2. The logarithms of those terms are summed in double precision together
+ * with a bound on the rounding error of the sum, which settles the comparison
+ * with log 2 unless the true value may lie within the bound of it. Only then
+ * are sigma(d) and 2d multiplied out and compared exactly. The abundance
+ * printed by the tools, sigma(d) / d - 1, is taken from the logarithm too.
+ *
+ * (C) Alexander Jones, 2021. My own code is under the MIT License, which is
+ * included in this repository.
+ */
+
+#ifndef ABUNDANCE_H
+#define ABUNDANCE_H
+
+#include <cstdint>
+#include <cmath>
+
+#include <gmpxx.h>
+
+#include "factorlist.h"
+
+// Running sum of log(sigma(p^k) / p^k) with its error bound
+class AbundanceBound {
+public:
+    AbundanceBound() : logSum(0), error(0) {}
+
+    void add(uint64_t prime, uint64_t multiplicity);
+    void add(const mpz_class & prime, uint64_t multiplicity);
+    void add(const FactorList & factors);
+
+    // 1 if sigma(d) > 2d for certain, -1 if sigma(d) <= 2d for certain, 0 if the bound cannot tell
+    int decide() const;
+
+    // sigma(d) / d - 1
+    double abundance() const { return expm1(logSum); }
+
+private:
+    double logSum;
+    double error; // |logSum - log(sigma(d) / d)| is at most this
+
+    void addReciprocal(double x, uint64_t multiplicity);
+};
+
+// Exactly whether sigma(d) > 2d, as product(p^(k+1) - 1) > 2 * product(p^k * (p - 1))
+bool exactlyAbundant(const FactorList & factors);
+
+// Whether the factors make index 1 abundant, setting abundance to sigma(d) / d - 1
+bool isAbundant(const FactorList & factors, double & abundance);
+
+#endif
@@ -0,0 +1,60 @@
+/* Microbenchmarks for the aliquot power tools.
+ *
+ * (C) Alexander Jones, 2021. My own code is under the MIT License, which is
+ * included in this repository.
+ */
+
+#include "benchmark.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cinttypes>
+#include <atomic>
+
+#include <gmp.h>
+
+using namespace std;
+
+static atomic<uint64_t> allocations(0);
+
+// GMP's defaults are malloc, realloc and free too, so blocks made before counting began are freed safely
+static void *countedAllocate(size_t size) {
+    allocations.fetch_add(1, memory_order_relaxed);
+    void *block = malloc(size);
+    if (block == NULL) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        abort();
+    }
+    return block;
+}
+
+static void *countedReallocate(void *block, size_t /*oldSize*/, size_t newSize) {
+    allocations.fetch_add(1, memory_order_relaxed);
+    block = realloc(block, newSize);
+    if (block == NULL) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        abort();
+    }
+    return block;
+}
+
+static void countedFree(void *block, size_t /*size*/) {
+    free(block);
+}
+
+Benchmark::Benchmark(const string & tool) : tool(tool) {
+    mp_set_memory_functions(countedAllocate, countedReallocate, countedFree);
+}
+
+uint64_t Benchmark::allocationCount() {
+    return allocations.load(memory_order_relaxed);
+}
+
+void Benchmark::report(const string & kernel, const string & name, uint64_t candidates, double seconds, uint64_t allocationTotal) {
+    double perCandidate = candidates ? 1.0 / candidates : 0;
+    printf("{\"tool\": \"%s\", \"kernel\": \"%s\", \"case\": \"%s\", \"candidates\": %" PRIu64 ", \"seconds\": %.6f, "
+           "\"candidatesPerSec\": %.1f, \"nsPerCandidate\": %.2f, \"allocationsPerCandidate\": %.4f}\n",
+           tool.c_str(), kernel.c_str(), name.c_str(), candidates, seconds,
+           seconds > 0 ? candidates / seconds : 0, seconds * 1e9 * perCandidate, allocationTotal * perCandidate);
+    fflush(stdout);
+}
@@ -0,0 +1,59 @@
+/* Microbenchmarks for the aliquot power tools.
+ *
+ * Each tool's --bench suite runs its kernels on fixed inputs through a
+ * Benchmark, which times every case (best of a few runs), counts the GMP
+ * allocations made meanwhile, and prints one JSON line per case:
+ *
+ *   {"tool":..., "kernel":..., "case":..., "candidates":..., "seconds":...,
+ *    "candidatesPerSec":..., "nsPerCandidate":..., "allocationsPerCandidate":...}
+ *
+ * A candidate is the kernel's unit of work: a prime tried as a divisor, or a
+ * number handled. Only GMP's allocations are counted, through
+ * mp_set_memory_functions, so containers growing are not.
+ *
+ * (C) Alexander Jones, 2021. My own code is under the MIT License, which is
+ * included in this repository.
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <cstdint>
+#include <string>
+#include <chrono>
+
+#define BENCH_RUNS 3
+
+class Benchmark {
+public:
+    // Starts counting GMP's allocations, which stays in place for the rest of the program
+    explicit Benchmark(const std::string & tool);
+
+    // Time body() over the given number of candidates and print the line for the case
+    template <typename Kernel>
+    void run(const std::string & kernel, const std::string & name, uint64_t candidates, Kernel body) {
+        double best = 0;
+        uint64_t allocations = 0;
+        for (int i = 0; i < BENCH_RUNS; i++) {
+            uint64_t allocationsBefore = allocationCount();
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            body();
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            allocations = allocationCount() - allocationsBefore;
+            if (i == 0 || elapsed.count() < best) {
+                best = elapsed.count();
+            }
+        }
+        report(kernel, name, candidates, best, allocations);
+    }
+
+    // GMP allocations (and reallocations) since the first Benchmark was made
+    static uint64_t allocationCount();
+
+private:
+    std::string tool;
+
+    void report(const std::string & kernel, const std::string & name, uint64_t candidates, double seconds, uint64_t allocations);
+};
+
+#endif
@@ -0,0 +1,310 @@
+/* Persistent factor cache for the aliquot power tools.
+ *
+ * File layout, all integers in host byte order:
+ *   header:  "APFCACHE" and a uint32_t version
+ *   record:  uint32_t size of the rest of the record
+ *            uint8_t kind, uint64_t limit
+ *            the base and the index, each a uint16_t byte count and big-endian magnitude
+ *            uint32_t factor count, then per factor the prime as above and a uint64_t multiplicity
+ * A record cut short by a crash is ignored, and the next append overwrites it.
+ *
+ * (C) Alexander Jones, 2021. My own code is under the MIT License, which is
+ * included in this repository.
+ */
+
+#include "factorcache.h"
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+#define CACHE_MAGIC "APFCACHE"
+#define CACHE_MAGIC_SIZE 8
+#define CACHE_VERSION 1
+#define CACHE_HEADER_SIZE (CACHE_MAGIC_SIZE + 4)
+#define RECORD_KEY_MAX (1 + 8 + 2 * (2 + 65535)) // kind, limit, base, index
+
+// Append a number as a uint16_t byte count and its big-endian magnitude
+static void putNumber(string & buffer, const mpz_class & n) {
+    size_t count = (mpz_sizeinbase(n.get_mpz_t(), 2) + 7) / 8;
+    if (n == 0) {
+        count = 0;
+    }
+    uint16_t size = count;
+    buffer.append((const char *) &size, sizeof(size));
+    buffer.resize(buffer.size() + count);
+    if (count) {
+        mpz_export(&buffer[buffer.size() - count], NULL, 1, 1, 1, 0, n.get_mpz_t());
+    }
+}
+
+// As putNumber, for a number held in a word
+static void putNumber(string & buffer, uint64_t n) {
+    uint16_t size = 0;
+    unsigned char bytes[sizeof(n)];
+    for (; n; n >>= 8) {
+        bytes[sizeof(n) - ++size] = n & 0xff;
+    }
+    buffer.append((const char *) &size, sizeof(size));
+    buffer.append((const char *) bytes + sizeof(n) - size, size);
+}
+
+template <typename T>
+static void putWord(string & buffer, T word) {
+    buffer.append((const char *) &word, sizeof(word));
+}
+
+// Read a number written by putNumber, advancing position; false if it runs past end
+static bool getNumber(const string & buffer, size_t & position, mpz_class & n) {
+    uint16_t size;
+    if (position + sizeof(size) > buffer.size()) {
+        return false;
+    }
+    memcpy(&size, &buffer[position], sizeof(size));
+    position += sizeof(size);
+    if (position + size > buffer.size()) {
+        return false;
+    }
+    mpz_import(n.get_mpz_t(), size, 1, 1, 1, 0, buffer.data() + position);
+    position += size;
+    return true;
+}
+
+// As getNumber, into a word; a number which does not fit one reads as UINT64_MAX
+static bool getNumber(const string & buffer, size_t & position, uint64_t & n) {
+    uint16_t size;
+    if (position + sizeof(size) > buffer.size()) {
+        return false;
+    }
+    memcpy(&size, &buffer[position], sizeof(size));
+    position += sizeof(size);
+    if (position + size > buffer.size()) {
+        return false;
+    }
+    n = 0;
+    for (uint16_t i = 0; i < size; i++) {
+        n = n << 8 | (unsigned char) buffer[position + i];
+    }
+    if (size > sizeof(n)) {
+        n = UINT64_MAX;
+    }
+    position += size;
+    return true;
+}
+
+template <typename T>
+static bool getWord(const string & buffer, size_t & position, T & word) {
+    if (position + sizeof(word) > buffer.size()) {
+        return false;
+    }
+    memcpy(&word, &buffer[position], sizeof(word));
+    position += sizeof(word);
+    return true;
+}
+
+// The index key: kind, base and index in the same encoding as the file
+static string makeKey(uint8_t kind, const mpz_class & base, const mpz_class & index) {
+    string key(1, (char) kind);
+    putNumber(key, base);
+    putNumber(key, index);
+    return key;
+}
+
+static bool readFully(int fd, string & buffer, size_t size, uint64_t offset) {
+    buffer.resize(size);
+    size_t done = 0;
+    while (done < size) {
+        ssize_t count = pread(fd, &buffer[done], size - done, offset + done);
+        if (count <= 0) {
+            return false;
+        }
+        done += count;
+    }
+    return true;
+}
+
+FactorCache::FactorCache() : fd(-1), scannedEnd(CACHE_HEADER_SIZE) {
+}
+
+FactorCache::~FactorCache() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+bool FactorCache::open(const string & filename) {
+    fd = ::open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    flock(fd, LOCK_EX);
+    string header;
+    struct stat info;
+    bool valid = fstat(fd, &info) == 0;
+    if (valid && info.st_size == 0) {
+        header = CACHE_MAGIC;
+        putWord(header, (uint32_t) CACHE_VERSION);
+        valid = pwrite(fd, header.data(), header.size(), 0) == (ssize_t) header.size();
+    } else if (valid) {
+        uint32_t version = 0;
+        size_t position = CACHE_MAGIC_SIZE;
+        valid = readFully(fd, header, CACHE_HEADER_SIZE, 0) && header.compare(0, CACHE_MAGIC_SIZE, CACHE_MAGIC) == 0
+                && getWord(header, position, version) && version == CACHE_VERSION;
+    }
+    flock(fd, LOCK_UN);
+
+    if (!valid) {
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    lock_guard<mutex> lock(cacheMutex);
+    scan();
+    return true;
+}
+
+void FactorCache::addEntry(const string & key, uint64_t offset, uint64_t limit) {
+    map<string, Entry>::iterator it = index.find(key);
+    if (it == index.end() || it->second.limit < limit) {
+        Entry & entry = index[key];
+        entry.offset = offset;
+        entry.limit = limit;
+    }
+}
+
+// Index the records appended since the last scan
+void FactorCache::scan() {
+    flock(fd, LOCK_SH);
+    scanLocked();
+    flock(fd, LOCK_UN);
+}
+
+// As scan, with the file lock already held; returns the file size
+uint64_t FactorCache::scanLocked() {
+    struct stat info;
+    uint64_t end = scannedEnd;
+    if (fstat(fd, &info) == 0) {
+        end = info.st_size;
+        string buffer;
+        while (scannedEnd + sizeof(uint32_t) <= end) {
+            uint32_t size;
+            size_t position = 0;
+            if (!readFully(fd, buffer, sizeof(size), scannedEnd) || !getWord(buffer, position, size) || scannedEnd + sizeof(size) + size > end) {
+                break;
+            }
+            uint64_t recordStart = scannedEnd + sizeof(size);
+            if (!readFully(fd, buffer, min((uint64_t) size, (uint64_t) RECORD_KEY_MAX), recordStart)) {
+                break;
+            }
+
+            uint8_t kind;
+            uint64_t limit;
+            mpz_class base, number;
+            position = 0;
+            if (getWord(buffer, position, kind) && getWord(buffer, position, limit)) {
+                size_t keyStart = position;
+                if (getNumber(buffer, position, base) && getNumber(buffer, position, number)) {
+                    addEntry(string(1, (char) kind) + buffer.substr(keyStart, position - keyStart), recordStart + position, limit);
+                }
+            }
+            scannedEnd = recordStart + size;
+        }
+    }
+    return end;
+}
+
+uint64_t FactorCache::lookup(Kind kind, const mpz_class & base, const mpz_class & number, uint64_t limit, FactorList & factors) {
+    factors.clear();
+    if (fd < 0) {
+        return 0;
+    }
+
+    string key = makeKey(kind, base, number);
+    Entry entry;
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        map<string, Entry>::iterator it = index.find(key);
+        if (it == index.end() || it->second.limit < limit) {
+            scan();
+            it = index.find(key);
+        }
+        if (it == index.end()) {
+            return 0;
+        }
+        entry = it->second;
+    }
+
+    // The factor list runs to the end of the record, whose size precedes it
+    string buffer;
+    uint32_t size, count;
+    size_t position = 0;
+    uint64_t keySize = 1 + 8 + key.size() - 1;
+    if (!readFully(fd, buffer, sizeof(size), entry.offset - keySize - sizeof(size)) || !getWord(buffer, position, size)
+            || !readFully(fd, buffer, size - keySize, entry.offset)) {
+        return 0;
+    }
+    position = 0;
+    if (!getWord(buffer, position, count)) {
+        return 0;
+    }
+    // Every factor kept is below limit, so fits a word
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t prime, multiplicity;
+        if (!getNumber(buffer, position, prime) || !getWord(buffer, position, multiplicity)) {
+            factors.clear();
+            return 0;
+        }
+        if (prime < limit) {
+            factors.add(prime, multiplicity);
+        }
+    }
+    return min(entry.limit, limit);
+}
+
+bool FactorCache::append(Kind kind, const mpz_class & base, const mpz_class & number, uint64_t limit, const FactorList & factors) {
+    if (fd < 0 || mpz_sizeinbase(base.get_mpz_t(), 256) > UINT16_MAX || mpz_sizeinbase(number.get_mpz_t(), 256) > UINT16_MAX) {
+        return false;
+    }
+
+    string record;
+    putWord(record, (uint32_t) 0);
+    putWord(record, (uint8_t) kind);
+    putWord(record, limit);
+    putNumber(record, base);
+    putNumber(record, number);
+    uint64_t factorsStart = record.size() - sizeof(uint32_t);
+    putWord(record, (uint32_t) factors.size());
+    for (size_t i = 0; i < factors.size(); i++) {
+        if (factors.isWord(i)) {
+            putNumber(record, factors.word(i));
+        } else {
+            putNumber(record, factors.prime(i));
+        }
+        putWord(record, factors.multiplicity(i));
+    }
+    uint32_t size = record.size() - sizeof(size);
+    memcpy(&record[0], &size, sizeof(size));
+
+    lock_guard<mutex> lock(cacheMutex);
+    flock(fd, LOCK_EX);
+    // Writers hold the lock until their record is complete, so anything past the last whole record is
+    // left over from a crash
+    if (scanLocked() > scannedEnd && ftruncate(fd, scannedEnd) != 0) {
+        flock(fd, LOCK_UN);
+        return false;
+    }
+    uint64_t end = scannedEnd;
+    bool written = pwrite(fd, record.data(), record.size(), end) == (ssize_t) record.size();
+    if (written) {
+        addEntry(makeKey(kind, base, number), end + sizeof(size) + factorsStart, limit);
+        scannedEnd = end + record.size();
+    }
+    flock(fd, LOCK_UN);
+    return written;
+}
@@ -0,0 +1,67 @@
+/* Persistent factor cache for the aliquot power tools.
+ *
+ * An append-only binary file of trial factoring results. Each record holds
+ * every prime below its limit which divides a number, keyed by the kind of
+ * number, a base and an index (the exponent for index 1 of base^exponent, d
+ * for the cyclotomic value Phi_d(base)). Records are length-prefixed, so the
+ * in-memory index is built by reading only their keys, and it is brought up to
+ * date on a miss so that records appended by other processes are found.
+ * Appends take an exclusive lock on the file, so several tools can share one.
+ *
+ * (C) Alexander Jones, 2021. My own code is under the MIT License, which is
+ * included in this repository.
+ */
+
+#ifndef FACTORCACHE_H
+#define FACTORCACHE_H
+
+#include <cstdint>
+#include <string>
+#include <map>
+#include <mutex>
+
+#include <gmpxx.h>
+
+#include "factorlist.h"
+
+class FactorCache {
+public:
+    enum Kind {
+        INDEX_ONE = 1, // sigma(base^index) - base^index
+        CYCLOTOMIC = 2 // Phi_index(base)
+    };
+
+    FactorCache();
+    ~FactorCache();
+
+    // Open (or create) the cache file
+    bool open(const std::string & filename);
+    bool isOpen() const { return fd >= 0; }
+
+    // Fetch the factors below limit from the record of the key with the highest limit. Returns the limit
+    // the factors are complete to (at most limit), or 0 when nothing is cached.
+    uint64_t lookup(Kind kind, const mpz_class & base, const mpz_class & index, uint64_t limit, FactorList & factors);
+
+    // Record every prime factor below limit of the number for this key
+    bool append(Kind kind, const mpz_class & base, const mpz_class & index, uint64_t limit, const FactorList & factors);
+
+private:
+    struct Entry {
+        uint64_t offset; // of the record's factor list
+        uint64_t limit;
+    };
+
+    int fd;
+    uint64_t scannedEnd; // records before this offset are in the index
+    std::map<std::string, Entry> index;
+    std::mutex cacheMutex;
+
+    void scan();
+    uint64_t scanLocked();
+    void addEntry(const std::string & key, uint64_t offset, uint64_t limit);
+
+    FactorCache(const FactorCache &);
+    FactorCache & operator=(const FactorCache &);
+};
+
+#endif
@@ -0,0 +1,209 @@
+/* Complete factorization of the moderate numbers the aliquot power tools
+ * need whole, such as the base of a power.
+ *
+ * (C) Alexander Jones, 2021. My own code is under the MIT License, which is
+ * included in this repository.
+ */
+
+#include "factorengine.h"
+
+#include <climits>
+#include <algorithm>
+#include <vector>
+#include <utility>
+
+#include <primesieve.hpp>
+
+using namespace std;
+
+#define PRIME_TEST_REPS 25
+#define TRIAL_BATCH 16 // the most primes whose product is taken as one divisor
+#define RHO_CONSTANTS 4 // polynomials x^2 + c tried before giving up on rho
+#define RHO_GCD_STEPS 128 // rho steps whose differences are multiplied together before a gcd
+#define PM1_GCD_PRIMES 1024 // P-1 primes applied between gcds
+
+// Divide every power of prime out of n
+static void divideOut(mpz_class & n, uint64_t prime, FactorList & factors) {
+    uint64_t multiplicity = 0;
+    while (mpz_divisible_ui_p(n.get_mpz_t(), prime)) {
+        mpz_divexact_ui(n.get_mpz_t(), n.get_mpz_t(), prime);
+        multiplicity++;
+    }
+    factors.add(prime, multiplicity);
+}
+
+// Trial divide n by the primes below bound, leaving n at 1 once it is known to be fully factored
+static void trialDivide(mpz_class & n, uint64_t bound, FactorList & factors) {
+    primesieve::iterator it;
+    uint64_t batch[TRIAL_BATCH];
+    uint64_t prime = it.next_prime();
+    while (prime < bound) {
+        // One reduction of n by a word-sized product of primes, then a word remainder per prime
+        unsigned long product = 1;
+        int count = 0;
+        for (; prime < bound && count < TRIAL_BATCH && product <= ULONG_MAX / prime; prime = it.next_prime()) {
+            product *= prime;
+            batch[count++] = prime;
+        }
+        unsigned long remainder = mpz_fdiv_ui(n.get_mpz_t(), product);
+        bool shrank = false;
+        for (int i = 0; i < count; i++) {
+            if (remainder % batch[i] == 0) {
+                divideOut(n, batch[i], factors);
+                shrank = true;
+            }
+        }
+
+        if (mpz_cmp_ui(n.get_mpz_t(), 1) == 0) {
+            return;
+        }
+        // Every prime below the next one has been tried, so a cofactor below its square is prime; otherwise
+        // only a cofactor that just shrank can have become prime
+        if ((prime < (1ULL << 32) && mpz_cmp_ui(n.get_mpz_t(), prime * prime) < 0) ||
+            (shrank && mpz_probab_prime_p(n.get_mpz_t(), PRIME_TEST_REPS))) {
+            factors.add(n);
+            n = 1;
+            return;
+        }
+    }
+}
+
+// y = y^2 + c (mod n)
+static inline void rhoStep(mpz_class & y, unsigned long c, const mpz_class & n) {
+    mpz_mul(y.get_mpz_t(), y.get_mpz_t(), y.get_mpz_t());
+    mpz_add_ui(y.get_mpz_t(), y.get_mpz_t(), c);
+    mpz_mod(y.get_mpz_t(), y.get_mpz_t(), n.get_mpz_t());
+}
+
+// Pollard rho with Brent's cycle finding, taking one gcd per RHO_GCD_STEPS steps. True with a nontrivial
+// factor of the composite n in factor, found within about the given number of steps.
+static bool pollardRho(const mpz_class & n, uint64_t iterations, mpz_class & factor) {
+    mpz_class x, y, saved, product, difference;
+    uint64_t steps = 0;
+    for (unsigned long c = 1; c <= RHO_CONSTANTS && steps < iterations; c++) {
+        y = 2;
+        product = 1;
+        factor = 1;
+        for (uint64_t r = 1; factor == 1 && steps < iterations; r *= 2) {
+            x = y;
+            for (uint64_t i = 0; i < r; i++) {
+                rhoStep(y, c, n);
+            }
+            steps += r;
+            for (uint64_t k = 0; k < r && factor == 1; k += RHO_GCD_STEPS) {
+                saved = y;
+                uint64_t count = min((uint64_t) RHO_GCD_STEPS, r - k);
+                for (uint64_t i = 0; i < count; i++) {
+                    rhoStep(y, c, n);
+                    difference = x - y;
+                    product *= difference;
+                    mpz_mod(product.get_mpz_t(), product.get_mpz_t(), n.get_mpz_t());
+                }
+                steps += count;
+                mpz_gcd(factor.get_mpz_t(), product.get_mpz_t(), n.get_mpz_t());
+            }
+        }
+        if (factor == n) {
+            // The product went to 0 mod n; retrace those steps one gcd at a time
+            do {
+                rhoStep(saved, c, n);
+                difference = x - saved;
+                mpz_gcd(factor.get_mpz_t(), difference.get_mpz_t(), n.get_mpz_t());
+            } while (factor == 1);
+        }
+        if (factor > 1 && factor < n) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// P-1 stage 1: a = 2^E (mod n), E the product of the largest powers of the primes below bound that are at
+// most bound, finds any prime p of n with p - 1 that smooth. True with a nontrivial factor in factor.
+static bool pollardPm1(const mpz_class & n, uint64_t bound, mpz_class & factor) {
+    mpz_class a = 2, saved;
+    vector<uint64_t> powers; // the prime powers applied since saved
+    primesieve::iterator it;
+    uint64_t prime = it.next_prime();
+    while (prime < bound) {
+        saved = a;
+        powers.clear();
+        for (; prime < bound && powers.size() < PM1_GCD_PRIMES; prime = it.next_prime()) {
+            uint64_t power = prime;
+            while (power <= bound / prime) {
+                power *= prime;
+            }
+            mpz_powm_ui(a.get_mpz_t(), a.get_mpz_t(), power, n.get_mpz_t());
+            powers.push_back(power);
+        }
+        factor = a - 1;
+        mpz_gcd(factor.get_mpz_t(), factor.get_mpz_t(), n.get_mpz_t());
+        if (factor == n) {
+            // Every prime of n at once: redo the run one power at a time, which separates them unless the same
+            // power completes them all
+            a = saved;
+            for (vector<uint64_t>::size_type i = 0; i < powers.size(); i++) {
+                mpz_powm_ui(a.get_mpz_t(), a.get_mpz_t(), powers[i], n.get_mpz_t());
+                factor = a - 1;
+                mpz_gcd(factor.get_mpz_t(), factor.get_mpz_t(), n.get_mpz_t());
+                if (factor != 1) {
+                    break;
+                }
+            }
+            return factor > 1 && factor < n;
+        }
+        if (factor > 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool factorCompletely(const mpz_class & n, const FactoringBounds & bounds, FactorList & factors, mpz_class & cofactor) {
+    factors.clear();
+    cofactor = 1;
+    if (mpz_probab_prime_p(n.get_mpz_t(), PRIME_TEST_REPS)) {
+        factors.add(n);
+        return true;
+    }
+
+    mpz_class m = n;
+    trialDivide(m, bounds.trialBound, factors);
+
+    // Parts of n left to factor, with their multiplicities
+    vector<pair<mpz_class, uint64_t> > parts;
+    if (m > 1) {
+        parts.push_back(make_pair(m, 1));
+    }
+    mpz_class part, factor, power;
+    while (!parts.empty()) {
+        part.swap(parts.back().first);
+        uint64_t multiplicity = parts.back().second;
+        parts.pop_back();
+        if (mpz_probab_prime_p(part.get_mpz_t(), PRIME_TEST_REPS)) {
+            factors.add(part, multiplicity);
+            continue;
+        }
+        // Rho and P-1 rarely split a prime power, which is quick to take apart directly
+        if (mpz_perfect_power_p(part.get_mpz_t())) {
+            for (unsigned long k = 2; ; k++) {
+                if (mpz_root(factor.get_mpz_t(), part.get_mpz_t(), k)) {
+                    parts.push_back(make_pair(factor, multiplicity * k));
+                    break;
+                }
+            }
+            continue;
+        }
+        if (pollardRho(part, bounds.rhoIterations, factor) || pollardPm1(part, bounds.pm1Bound, factor)) {
+            parts.push_back(make_pair(factor, multiplicity));
+            mpz_divexact(part.get_mpz_t(), part.get_mpz_t(), factor.get_mpz_t());
+            parts.push_back(make_pair(part, multiplicity));
+        } else {
+            mpz_pow_ui(power.get_mpz_t(), part.get_mpz_t(), multiplicity);
+            cofactor *= power;
+        }
+    }
+
+    factors.merge();
+    return cofactor == 1;
+}
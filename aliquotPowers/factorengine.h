@@ -0,0 +1,40 @@
+/* Complete factorization of the moderate numbers the aliquot power tools
+ * need whole, such as the base of a power.
+ *
+ * Trial division comes first. Runs of primes are multiplied into one machine
+ * word so that each pass over the number tests several of them, and the
+ * cofactor is tested for primality only after it shrinks, or not at all once
+ * the next prime squared exceeds it. Whatever composite part is left is split
+ * by Pollard rho (Brent's variant) and then by P-1 stage 1, each within its
+ * bound. A part neither can split is returned as a composite cofactor rather
+ * than dropped.
+ *
+ * (C) Alexander Jones, 2021. My own code is under the MIT License, which is
+ * included in this repository.
+ */
+
+#ifndef FACTORENGINE_H
+#define FACTORENGINE_H
+
+#include <cstdint>
+
+#include <gmpxx.h>
+
+#include "factorlist.h"
+
+#define DEFAULT_TRIAL_BOUND 1000000
+#define DEFAULT_RHO_ITERATIONS (1 << 20)
+#define DEFAULT_PM1_BOUND 1000000
+
+// Work limits for each stage
+struct FactoringBounds {
+    uint64_t trialBound = DEFAULT_TRIAL_BOUND; // trial divide by the primes below this
+    uint64_t rhoIterations = DEFAULT_RHO_ITERATIONS; // Pollard rho steps for each composite part
+    uint64_t pm1Bound = DEFAULT_PM1_BOUND; // P-1 stage 1 bound B1
+};
+
+// Factor n > 0 into factors, merged. True if the factorization is complete; otherwise the composite parts
+// no stage could split are left out of factors, and cofactor is their product.
+bool factorCompletely(const mpz_class & n, const FactoringBounds & bounds, FactorList & factors, mpz_class & cofactor);
+
+#endif
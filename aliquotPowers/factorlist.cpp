@@ -0,0 +1,230 @@
+/* Prime factorizations for the aliquot power tools.
+ *
+ * (C) Alexander Jones, 2021. My own code is under the MIT License, which is
+ * included in this repository.
+ */
+
+#include "factorlist.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <utility>
+
+using namespace std;
+
+#define TERM_SEPARATORS " \t\r*"
+
+// Sort one part of a list by prime and combine repeats in place
+template <typename Prime>
+static void sortPart(vector<Prime> & primes, vector<uint64_t> & multiplicities) {
+    if (!is_sorted(primes.begin(), primes.end())) {
+        vector<pair<Prime, uint64_t> > entries(primes.size());
+        for (size_t i = 0; i < primes.size(); i++) {
+            swap(entries[i].first, primes[i]);
+            entries[i].second = multiplicities[i];
+        }
+        sort(entries.begin(), entries.end());
+        for (size_t i = 0; i < primes.size(); i++) {
+            swap(primes[i], entries[i].first);
+            multiplicities[i] = entries[i].second;
+        }
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < primes.size(); i++) {
+        if (count && primes[count - 1] == primes[i]) {
+            multiplicities[count - 1] += multiplicities[i];
+        } else {
+            if (count != i) {
+                swap(primes[count], primes[i]);
+                multiplicities[count] = multiplicities[i];
+            }
+            count++;
+        }
+    }
+    primes.resize(count);
+    multiplicities.resize(count);
+}
+
+// Merge a sorted part of another list into the same part of this one
+template <typename Prime>
+static void mergePart(vector<Prime> & primes, vector<uint64_t> & multiplicities,
+                      const vector<Prime> & otherPrimes, const vector<uint64_t> & otherMultiplicities) {
+    if (otherPrimes.empty()) {
+        return;
+    }
+    // Results usually arrive in ascending order, so most merges just append
+    if (primes.empty() || primes.back() < otherPrimes.front()) {
+        primes.insert(primes.end(), otherPrimes.begin(), otherPrimes.end());
+        multiplicities.insert(multiplicities.end(), otherMultiplicities.begin(), otherMultiplicities.end());
+        return;
+    }
+
+    vector<Prime> mergedPrimes;
+    vector<uint64_t> mergedMultiplicities;
+    mergedPrimes.reserve(primes.size() + otherPrimes.size());
+    mergedMultiplicities.reserve(primes.size() + otherPrimes.size());
+    size_t i = 0, j = 0;
+    while (i < primes.size() || j < otherPrimes.size()) {
+        if (j == otherPrimes.size() || (i < primes.size() && primes[i] < otherPrimes[j])) {
+            mergedPrimes.push_back(primes[i]);
+            mergedMultiplicities.push_back(multiplicities[i++]);
+        } else if (i == primes.size() || otherPrimes[j] < primes[i]) {
+            mergedPrimes.push_back(otherPrimes[j]);
+            mergedMultiplicities.push_back(otherMultiplicities[j++]);
+        } else {
+            mergedPrimes.push_back(primes[i]);
+            mergedMultiplicities.push_back(multiplicities[i++] + otherMultiplicities[j++]);
+        }
+    }
+    primes.swap(mergedPrimes);
+    multiplicities.swap(mergedMultiplicities);
+}
+
+static bool isDigits(const string & s) {
+    return !s.empty() && s.find_first_not_of("0123456789") == string::npos;
+}
+
+void FactorList::clear() {
+    words.clear();
+    wordMultiplicities.clear();
+    large.clear();
+    largeMultiplicities.clear();
+}
+
+void FactorList::swap(FactorList & other) {
+    words.swap(other.words);
+    wordMultiplicities.swap(other.wordMultiplicities);
+    large.swap(other.large);
+    largeMultiplicities.swap(other.largeMultiplicities);
+}
+
+mpz_class FactorList::prime(size_t i) const {
+    if (i < words.size()) {
+        mpz_class p;
+        mpz_import(p.get_mpz_t(), 1, -1, sizeof(uint64_t), 0, 0, &words[i]);
+        return p;
+    }
+    return large[i - words.size()];
+}
+
+void FactorList::add(uint64_t prime, uint64_t multiplicity) {
+    words.push_back(prime);
+    wordMultiplicities.push_back(multiplicity);
+}
+
+void FactorList::add(const mpz_class & prime, uint64_t multiplicity) {
+    if (mpz_sizeinbase(prime.get_mpz_t(), 2) <= 64) {
+        uint64_t word = 0;
+        mpz_export(&word, NULL, -1, sizeof(uint64_t), 0, 0, prime.get_mpz_t());
+        add(word, multiplicity);
+    } else {
+        large.push_back(prime);
+        largeMultiplicities.push_back(multiplicity);
+    }
+}
+
+void FactorList::add(const FactorList & other, size_t i) {
+    if (other.isWord(i)) {
+        add(other.words[i], other.wordMultiplicities[i]);
+    } else {
+        add(other.large[i - other.words.size()], other.largeMultiplicities[i - other.words.size()]);
+    }
+}
+
+void FactorList::merge() {
+    sortPart(words, wordMultiplicities);
+    sortPart(large, largeMultiplicities);
+}
+
+void FactorList::merge(const FactorList & other) {
+    mergePart(words, wordMultiplicities, other.words, other.wordMultiplicities);
+    mergePart(large, largeMultiplicities, other.large, other.largeMultiplicities);
+}
+
+void FactorList::power(uint64_t k) {
+    for (size_t i = 0; i < wordMultiplicities.size(); i++) {
+        wordMultiplicities[i] *= k;
+    }
+    for (size_t i = 0; i < largeMultiplicities.size(); i++) {
+        largeMultiplicities[i] *= k;
+    }
+}
+
+void FactorList::primePower(size_t i, mpz_class & power) const {
+    if (i < words.size()) {
+        mpz_ui_pow_ui(power.get_mpz_t(), words[i], wordMultiplicities[i]);
+    } else {
+        mpz_pow_ui(power.get_mpz_t(), large[i - words.size()].get_mpz_t(), largeMultiplicities[i - words.size()]);
+    }
+}
+
+void FactorList::product(mpz_class & n) const {
+    mpz_class power;
+    n = 1;
+    for (size_t i = 0; i < size(); i++) {
+        primePower(i, power);
+        n *= power;
+    }
+}
+
+// sigma(p^k) = (p^(k+1) - 1) / (p - 1)
+void FactorList::sigma(mpz_class & s, mpz_class & n) const {
+    mpz_class p, power, t;
+    n = 1;
+    s = 1;
+    for (size_t i = 0; i < size(); i++) {
+        primePower(i, power);
+        n *= power;
+        if (multiplicity(i) == 1) {
+            t = power + 1;
+        } else {
+            p = prime(i);
+            t = power * p - 1;
+            mpz_divexact(t.get_mpz_t(), t.get_mpz_t(), mpz_class(p - 1).get_mpz_t());
+        }
+        s *= t;
+    }
+}
+
+string FactorList::toString() const {
+    string s;
+    for (size_t i = 0; i < size(); i++) {
+        if (i) {
+            s += " * ";
+        }
+        s += isWord(i) ? to_string(words[i]) : large[i - words.size()].get_str();
+        if (multiplicity(i) != 1) {
+            s += "^" + to_string(multiplicity(i));
+        }
+    }
+    return s;
+}
+
+bool FactorList::parse(const string & text) {
+    clear();
+    string::size_type position = 0;
+    while ((position = text.find_first_not_of(TERM_SEPARATORS, position)) != string::npos) {
+        string::size_type end = text.find_first_of(TERM_SEPARATORS, position);
+        string term = text.substr(position, end - position);
+        position = end;
+        if (term.compare(0, 9, "remainder") == 0) {
+            break;
+        }
+
+        string::size_type caret = term.find('^');
+        string primeText = term.substr(0, caret);
+        uint64_t multiplicity = 1;
+        if (!isDigits(primeText)) {
+            return false;
+        }
+        if (caret != string::npos) {
+            string multiplicityText = term.substr(caret + 1);
+            if (!isDigits(multiplicityText) || (multiplicity = strtoull(multiplicityText.c_str(), NULL, 10)) == 0) {
+                return false;
+            }
+        }
+        add(mpz_class(primeText), multiplicity);
+    }
+    return true;
+}
@@ -0,0 +1,70 @@
+/* Prime factorizations for the aliquot power tools.
+ *
+ * A FactorList holds primes with their multiplicities as parallel arrays.
+ * Primes below 2^64, which are nearly all of them, are kept inline as machine
+ * words; only larger ones are mpz_class values. Every word entry comes before
+ * every large one, so once merged (sorted, with repeated primes combined) the
+ * whole list is in ascending order, and two merged lists combine in one pass.
+ *
+ * (C) Alexander Jones, 2021. My own code is under the MIT License, which is
+ * included in this repository.
+ */
+
+#ifndef FACTORLIST_H
+#define FACTORLIST_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <gmpxx.h>
+
+class FactorList {
+public:
+    size_t size() const { return words.size() + large.size(); }
+    bool empty() const { return words.empty() && large.empty(); }
+    void clear();
+    void swap(FactorList & other);
+
+    // Entry i's prime fits in a word, and then is word(i)
+    bool isWord(size_t i) const { return i < words.size(); }
+    uint64_t word(size_t i) const { return words[i]; }
+    mpz_class prime(size_t i) const;
+    uint64_t multiplicity(size_t i) const {
+        return i < words.size() ? wordMultiplicities[i] : largeMultiplicities[i - words.size()];
+    }
+
+    // Append an entry; until the next merge, word and large entries each keep the order they were added in
+    void add(uint64_t prime, uint64_t multiplicity = 1);
+    void add(const mpz_class & prime, uint64_t multiplicity = 1);
+    void add(const FactorList & other, size_t i);
+
+    // Sort by prime and combine repeated primes
+    void merge();
+    // Combine with another merged list, in time linear in both
+    void merge(const FactorList & other);
+
+    // Turn the factorization of n into that of n^k
+    void power(uint64_t k);
+
+    // p^k for entry i
+    void primePower(size_t i, mpz_class & power) const;
+    // n = product(p^k)
+    void product(mpz_class & n) const;
+    // s = sigma(n) and n = product(p^k)
+    void sigma(mpz_class & s, mpz_class & n) const;
+
+    // "p * q^k * ..."
+    std::string toString() const;
+    // Replace the list with the factors of a string like toString's, which ends at a "remainder" term if it
+    // has one; false if a term is not a number with an optional "^<multiplicity>"
+    bool parse(const std::string & text);
+
+private:
+    std::vector<uint64_t> words;
+    std::vector<uint64_t> wordMultiplicities;
+    std::vector<mpz_class> large;
+    std::vector<uint64_t> largeMultiplicities;
+};
+
+#endif
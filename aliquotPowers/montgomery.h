@@ -0,0 +1,161 @@
+/* Word-sized modular arithmetic for the aliquot power tools.
+ *
+ * Montgomery multiplication modulo an odd 64-bit or 128-bit modulus, plus
+ * plain wrapping arithmetic for the power-of-two part of an even modulus.
+ * Nothing here allocates, so it is safe to use in per-prime hot loops.
+ *
+ * (C) Alexander Jones, 2021. My own code is under the MIT License, which is
+ * included in this repository.
+ */
+
+#ifndef MONTGOMERY_H
+#define MONTGOMERY_H
+
+#include <cstdint>
+#include <vector>
+
+typedef unsigned __int128 uint128_t;
+
+// Full product of two words as a (high, low) pair
+inline void mulWide(uint64_t a, uint64_t b, uint64_t & high, uint64_t & low) {
+    uint128_t product = (uint128_t) a * b;
+    high = (uint64_t) (product >> 64);
+    low = (uint64_t) product;
+}
+
+inline void mulWide(uint128_t a, uint128_t b, uint128_t & high, uint128_t & low) {
+    const uint128_t mask = ~(uint64_t) 0;
+    uint128_t ll = (a & mask) * (b & mask);
+    uint128_t lh = (a & mask) * (b >> 64);
+    uint128_t hl = (a >> 64) * (b & mask);
+    uint128_t hh = (a >> 64) * (b >> 64);
+    uint128_t middle = (ll >> 64) + (lh & mask) + (hl & mask);
+    low = (middle << 64) | (ll & mask);
+    high = hh + (lh >> 64) + (hl >> 64) + (middle >> 64);
+}
+
+// Number of trailing zero bits of a nonzero word
+inline int trailingZeros(uint64_t a) {
+    return __builtin_ctzll(a);
+}
+
+inline int trailingZeros(uint128_t a) {
+    uint64_t low = (uint64_t) a;
+    return low ? __builtin_ctzll(low) : 64 + __builtin_ctzll((uint64_t) (a >> 64));
+}
+
+// Raise a to the power given by little-endian 64-bit limbs (no high zero limb), using mul(x, y)
+template <typename Word, typename Mul>
+Word limbPower(Word a, Word one, const std::vector<uint64_t> & exponentLimbs, Mul mul) {
+    if (exponentLimbs.empty()) {
+        return one;
+    }
+    std::vector<uint64_t>::size_type i = exponentLimbs.size() - 1;
+    int bit = 62 - __builtin_clzll(exponentLimbs[i]);
+    Word result = a;
+    while (true) {
+        for (; bit >= 0; bit--) {
+            result = mul(result, result);
+            if ((exponentLimbs[i] >> bit) & 1) {
+                result = mul(result, a);
+            }
+        }
+        if (i-- == 0) {
+            return result;
+        }
+        bit = 63;
+    }
+}
+
+// Raise a to a single-word power, using mul(x, y)
+template <typename Word, typename Mul>
+Word wordPower(Word a, Word one, uint64_t exponent, Mul mul) {
+    Word result = one;
+    for (; exponent; exponent >>= 1) {
+        if (exponent & 1) {
+            result = mul(result, a);
+        }
+        if (exponent > 1) {
+            a = mul(a, a);
+        }
+    }
+    return result;
+}
+
+// Montgomery arithmetic modulo an odd Word-sized modulus, with R = 2^(bits of Word)
+template <typename Word>
+class Montgomery {
+public:
+    explicit Montgomery(Word modulus) : n(modulus) {
+        // Newton iteration for n^-1 mod R; n * n == 1 mod 8 gives the first three bits
+        inverse = n;
+        for (int bits = 3; bits < (int) sizeof(Word) * 8; bits *= 2) {
+            inverse *= 2 - n * inverse;
+        }
+        rModN = (Word) (0 - n) % n;
+        rSquared = squareR(rModN);
+    }
+
+    Word modulus() const { return n; }
+    Word one() const { return rModN; }
+
+    // a * b / R mod n, for a, b < n
+    Word multiply(Word a, Word b) const {
+        Word high, low, mnHigh, mnLow;
+        mulWide(a, b, high, low);
+        Word m = low * inverse;
+        mulWide(m, n, mnHigh, mnLow);
+        return high >= mnHigh ? high - mnHigh : high - mnHigh + n;
+    }
+
+    Word toMontgomery(Word a) const { return multiply(a % n, rSquared); }
+    Word fromMontgomery(Word a) const { return multiply(a, 1); }
+
+    Word add(Word a, Word b) const { return addMod(a, b); }
+    Word subtract(Word a, Word b) const { return a >= b ? a - b : a - b + n; }
+
+    Word power(Word a, const std::vector<uint64_t> & exponentLimbs) const {
+        return limbPower(a, rModN, exponentLimbs, [this](Word x, Word y) { return multiply(x, y); });
+    }
+
+    Word power(Word a, uint64_t exponent) const {
+        return wordPower(a, rModN, exponent, [this](Word x, Word y) { return multiply(x, y); });
+    }
+
+private:
+    Word n;
+    Word inverse;
+    Word rModN;
+    Word rSquared;
+
+    Word addMod(Word a, Word b) const {
+        Word sum = a + b;
+        return (sum < a || sum >= n) ? sum - n : sum;
+    }
+
+    // R^2 mod n from R mod n
+    uint64_t squareR(uint64_t r) const {
+        return (uint64_t) ((uint128_t) r * r % n);
+    }
+
+    uint128_t squareR(uint128_t r) const {
+        // No wider type to divide in, so double R mod n another 128 times
+        for (int i = 0; i < 128; i++) {
+            r = addMod(r, r);
+        }
+        return r;
+    }
+};
+
+// Arithmetic modulo 2^(bits of Word), where reduction is free
+template <typename Word>
+Word wrapPower(Word a, const std::vector<uint64_t> & exponentLimbs) {
+    return limbPower(a, (Word) 1, exponentLimbs, [](Word x, Word y) { return (Word) (x * y); });
+}
+
+template <typename Word>
+Word wrapPower(Word a, uint64_t exponent) {
+    return wordPower(a, (Word) 1, exponent, [](Word x, Word y) { return (Word) (x * y); });
+}
+
+#endif
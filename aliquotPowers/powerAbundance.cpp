@@ -1,9 +1,9 @@
 /* Aliquot integer power abundance calculator.
  *
  * This program scans an exponent range for a given base for an aliquot sum
- * which can be determined to be abundant based on its factors up to 10^4. It
- * will output any such exponents, along with the factors that establish
- * abundance, to a log file.
+ * which can be determined to be abundant based on its factors up to a trial
+ * factoring limit (10^4 by default). It will output any such exponents, along
+ * with the factors that establish abundance, to a log file.
  *
  * (C) Alexander Jones, 2021. My code is under the MIT License, which is
  * included in this repository.
@@ -14,144 +14,603 @@
  * disclaimer of warranty.
  */
 
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <iostream>
-#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <map>
 
 #include <gmpxx.h>
+#include <primesieve.hpp>
+
+#include "arg_parser.h"
+#include "montgomery.h"
+#include "factorlist.h"
+#include "factorcache.h"
+#include "resultwriter.h"
+#include "abundance.h"
+#include "benchmark.h"
 
 using namespace std;
 
-typedef vector<pair<mpz_class, int> > FactorVector;
+#define DEFAULT_TRIAL_LIMIT 10000
+#define MAX_TABLE_LIMIT 10000000 //above this the table and its trees are not kept in memory
+#define BATCH_PRIMES 2048 //trial primes per product tree
+#define SMALL_CYCLOTOMIC_D 32 //below this, Phi_d candidates are found by walking every trial prime
+
+//a product tree over <count> consecutive trial primes starting at <first>:
+//level 0 holds products of pairs of primes, the last level the product of the whole batch
+
+typedef struct {
+    size_t first;
+    size_t count;
+    vector<vector<mpz_class> > tree;
+} TrialBatch;
 
-vector<unsigned int> trial_primes; //precalced primes for trial factoring
+uint64_t trial_limit = DEFAULT_TRIAL_LIMIT; //trial factor by primes below this
+bool segmented_trial = false; //generate the trial primes batch by batch instead of keeping them
+vector<uint32_t> trial_primes; //precalced primes for trial factoring
+vector<TrialBatch> trial_batches; //product trees over trial_primes
 
-void factor(mpz_class n, FactorVector & factors);
+void factor(mpz_class n, FactorList & factors);
 
-void precalc_trial_primes() {
-    cout << "Precalcing primes for trial factoring..." << endl;
-    mpz_class p(2);
-    while (p < 10000) {
-        trial_primes.push_back(p.get_ui());
-        mpz_nextprime(p.get_mpz_t(), p.get_mpz_t());
+//builds the product tree over <count> of <primes> starting at <first>
+
+template <typename Prime>
+void build_batch(const vector<Prime> & primes, size_t first, size_t count, TrialBatch & batch) {
+    batch.first = first;
+    batch.count = count;
+    batch.tree.assign(1, vector<mpz_class>((count + 1) / 2));
+    vector<mpz_class> & pairs = batch.tree[0];
+    for (size_t j = 0; j < pairs.size(); ++j) {
+        pairs[j] = primes[first + 2 * j];
+        if (2 * j + 1 < count) pairs[j] *= (unsigned long) primes[first + 2 * j + 1];
+    }
+    while (batch.tree.back().size() > 1) {
+        vector<mpz_class> & below = batch.tree.back();
+        vector<mpz_class> level((below.size() + 1) / 2);
+        for (size_t j = 0; j < level.size(); ++j) {
+            level[j] = 2 * j + 1 < below.size() ? below[2 * j] * below[2 * j + 1] : below[2 * j];
+        }
+        batch.tree.push_back(level);
     }
 }
 
-//prints a log msg and adds <factor> to <factors>
+void precalc_trial_primes(bool quiet = false) {
+    trial_primes.clear();
+    trial_batches.clear();
+    segmented_trial = false;
+    if (trial_limit > MAX_TABLE_LIMIT) {
+        if (!quiet) cout << "Trial factoring limit too large to precalc; generating primes in batches" << endl;
+        segmented_trial = true;
+        return;
+    }
+
+    if (!quiet) cout << "Precalcing primes for trial factoring..." << endl;
+    if (trial_limit > 2) primesieve::generate_primes(trial_limit - 1, &trial_primes);
 
-void found_factor(mpz_class & factor, FactorVector & factors) {
-    factors.push_back(make_pair(factor, 1));
+    for (size_t first = 0; first < trial_primes.size(); first += BATCH_PRIMES) {
+        trial_batches.push_back(TrialBatch());
+        build_batch(trial_primes, first, min((size_t) BATCH_PRIMES, trial_primes.size() - first), trial_batches.back());
+    }
 }
 
-//sorts factors and merges any <p,x>,<p,y> into <p,x+y>
+//descends the product tree of <batch> from node <index> of <level>, given <remainder> = n mod that node,
+//and collects the trial primes dividing n in <divisors>
 
-void merge_factors(FactorVector & factors) {
-    sort(factors.begin(), factors.end());
-    for (FactorVector::size_type j = 1; j < factors.size();) {
-        if (factors[j].first == factors[j - 1].first) {
-            factors[j - 1].second += factors[j].second;
-            factors.erase(factors.begin() + j);
+template <typename Prime>
+void remainder_tree(const vector<Prime> & primes, const TrialBatch & batch, const mpz_class & remainder, size_t level, size_t index, vector<uint64_t> & divisors) {
+    size_t first = batch.first + (index << (level + 1));
+    size_t last = min(first + ((size_t) 2 << level), batch.first + batch.count);
+    const mpz_class & node = batch.tree[level][index];
+
+    if (remainder == 0) { //every prime below this node divides n
+        for (; first < last; ++first) divisors.push_back(primes[first]);
+        return;
+    }
+    if (level == 0 || mpz_fits_ulong_p(node.get_mpz_t())) { //small enough to finish with machine words
+        if (mpz_fits_ulong_p(remainder.get_mpz_t())) {
+            unsigned long r = remainder.get_ui();
+            for (; first < last; ++first) {
+                if (r % primes[first] == 0) divisors.push_back(primes[first]);
+            }
         } else {
-            ++j;
+            for (; first < last; ++first) {
+                if (mpz_divisible_ui_p(remainder.get_mpz_t(), primes[first])) divisors.push_back(primes[first]);
+            }
         }
+        return;
+    }
+
+    const vector<mpz_class> & below = batch.tree[level - 1];
+    mpz_class child_remainder;
+    for (size_t j = 2 * index; j < 2 * index + 2 && j < below.size(); ++j) {
+        mpz_fdiv_r(child_remainder.get_mpz_t(), remainder.get_mpz_t(), below[j].get_mpz_t());
+        remainder_tree(primes, batch, child_remainder, level - 1, j, divisors);
     }
 }
 
-//factors <n> and returns its prime components (with exponents) in <factors>.
-//vector<pair<p_i,x_i> >, n = product(p_i^x_i)
+//collects the primes of <batch> dividing <n> in <divisors>
+
+template <typename Prime>
+void batch_divisors(const vector<Prime> & primes, const TrialBatch & batch, const mpz_class & n, vector<uint64_t> & divisors) {
+    size_t top = batch.tree.size() - 1;
+    mpz_class remainder;
+    mpz_fdiv_r(remainder.get_mpz_t(), n.get_mpz_t(), batch.tree[top][0].get_mpz_t());
+    remainder_tree(primes, batch, remainder, top, 0, divisors);
+}
 
-void factor(mpz_class n, FactorVector & factors) {
+//factors <n> and returns its prime components (with exponents) in <factors>, n = product(p_i^x_i)
+//one reduction of <n> per batch of trial primes, then a remainder tree, finds the primes
+//that divide it; only those are divided out
+
+void factor(mpz_class n, FactorList & factors) {
     factors.clear();
+    if (n == 0) return;
+
+    vector<uint64_t> divisors;
+    if (!segmented_trial) {
+        for (size_t b = 0; b < trial_batches.size(); ++b) {
+            batch_divisors(trial_primes, trial_batches[b], n, divisors);
+        }
+    } else { //only one batch of primes and its tree in memory at a time
+        primesieve::iterator it;
+        vector<uint64_t> primes;
+        TrialBatch batch;
+        uint64_t p = it.next_prime();
+        while (p < trial_limit) {
+            primes.clear();
+            for (; p < trial_limit && primes.size() < BATCH_PRIMES; p = it.next_prime()) primes.push_back(p);
+            build_batch(primes, 0, primes.size(), batch);
+            batch_divisors(primes, batch, n, divisors);
+        }
+    }
 
-    for (vector<unsigned int>::size_type j = 0; j < trial_primes.size(); ++j) {
-        while (mpz_divisible_ui_p(n.get_mpz_t(), trial_primes[j])) {
-            mpz_class tp(trial_primes[j]);
-            found_factor(tp, factors);
-            mpz_divexact_ui(n.get_mpz_t(), n.get_mpz_t(), trial_primes[j]);
+    for (vector<uint64_t>::size_type j = 0; j < divisors.size(); ++j) {
+        unsigned long p = divisors[j];
+        int power = 0;
+        while (mpz_divisible_ui_p(n.get_mpz_t(), p)) {
+            mpz_divexact_ui(n.get_mpz_t(), n.get_mpz_t(), p);
+            power++;
         }
+        factors.add(p, power);
     }
 
-    merge_factors(factors); //sorts factors and merges any <p,x>,<p,y> into <p,x+y>
+    factors.merge(); //sorts factors and merges any <p,x>,<p,y> into <p,x+y>
+}
+
+void print_help() {
+    cout << "usage: powerAbundance <base> <minExp> <maxExp> [<skip>] [-t <threadCount>] [-l <limit>] [-c] [-f <cacheFile>]" << endl
+         << "                      [-o <outputFile>] [-j] [-s <syncSeconds>]" << endl;
+    cout << "  -c: factor index 1 through the cyclotomic values Phi_d(q) of a prime power base q^m" << endl;
+    cout << "  -f: reuse and record trial factors in a factor cache file shared with the other tools" << endl;
+    cout << "  -o: log abundant exponents to <outputFile> (default power_abundant_exponents); -j logs JSON lines" << endl;
+    cout << "  -s: sync the log to disk every <syncSeconds> (default only on exit)" << endl;
+    cout << "  --bench: time the factoring kernels on fixed inputs, printing one JSON line per case" << endl;
 }
 
-//calculates <n>=product(<factors>) and <s>=sigma(<n>)
+//returns the distinct prime factors of <n>
 
-void sigma(FactorVector & factors, mpz_class & s, mpz_class & n) {
-    mpz_class t, tmp, tmp2;
-    n = 1;
-    s = 1;
-    for (FactorVector::size_type j = 0; j < factors.size(); ++j) {
-        t = 1;
-        mpz_pow_ui(tmp.get_mpz_t(), factors[j].first.get_mpz_t(), factors[j].second + 1);
-        tmp -= 1;
-        tmp2 = factors[j].first - 1;
-        mpz_divexact(t.get_mpz_t(), tmp.get_mpz_t(), tmp2.get_mpz_t());
+vector<uint64_t> distinct_primes(uint64_t n) {
+    vector<uint64_t> primes;
+    for (uint64_t p = 2; p * p <= n; ++p) {
+        if (n % p) continue;
+        primes.push_back(p);
+        while (n % p == 0) n /= p;
+    }
+    if (n > 1) primes.push_back(n);
+    return primes;
+}
 
-        s *= t;
+//returns the multiplicity of the prime <p> in <q>^<e> - 1
 
-        mpz_pow_ui(tmp.get_mpz_t(), factors[j].first.get_mpz_t(), factors[j].second);
-        n *= tmp;
+int power_minus_one_valuation(const mpz_class & q, uint64_t e, unsigned long p) {
+    mpz_class modulus(p), r;
+    int v = 0;
+    while (true) {
+        mpz_powm_ui(r.get_mpz_t(), q.get_mpz_t(), e, modulus.get_mpz_t());
+        if (r != 1) return v;
+        v++;
+        modulus *= p;
     }
 }
 
-void print_help() {
-    cout << "usage: powerAbundance <base> <minExp> <maxExp> [<skip>]" << endl;
+//returns the multiplicity of the prime <p> in Phi_<d>(<q>) = product over squarefree s | d of (q^(d/s) - 1)^mu(s),
+//given the distinct prime factors <d_primes> of <d>
+
+int cyclotomic_valuation(const mpz_class & q, uint64_t d, const vector<uint64_t> & d_primes, unsigned long p) {
+    int v = 0;
+    for (unsigned long mask = 0; mask < (1UL << d_primes.size()); ++mask) {
+        uint64_t s = 1;
+        for (vector<uint64_t>::size_type j = 0; j < d_primes.size(); ++j) {
+            if (mask & (1UL << j)) s *= d_primes[j];
+        }
+        int term = power_minus_one_valuation(q, d / s, p);
+        v += __builtin_popcountl(mask) & 1 ? -term : term;
+    }
+    return v;
 }
 
-int main(int argc, char ** argv) {
-    if (argc < 4) {
-        print_help();
-        return 1;
+//returns the trial factors of Phi_<d>(<q>) in <factors> without forming it: a prime not dividing d
+//divides it only if the order of q mod p is d, so only p = 1 (mod d) and the primes of d are tried
+
+void cyclotomic_factor(const mpz_class & q, uint64_t d, FactorList & factors) {
+    factors.clear();
+    vector<uint64_t> d_primes = distinct_primes(d);
+
+    for (vector<uint64_t>::size_type j = 0; j < d_primes.size() && d_primes[j] < trial_limit; ++j) {
+        int v = cyclotomic_valuation(q, d, d_primes, d_primes[j]);
+        if (v > 0) factors.add(d_primes[j], v);
     }
 
+    auto try_prime = [&](uint64_t p) {
+        uint64_t q_mod = mpz_fdiv_ui(q.get_mpz_t(), p);
+        if (wordPower(q_mod, (uint64_t) 1, d, [p](uint64_t x, uint64_t y) { return (uint64_t) ((uint128_t) x * y % p); }) != 1) return;
+        int v = cyclotomic_valuation(q, d, d_primes, p);
+        if (v > 0) factors.add(p, v);
+    };
+    if (d < SMALL_CYCLOTOMIC_D) { //most primes qualify, so walk them all
+        if (!segmented_trial) {
+            for (vector<uint32_t>::size_type j = 0; j < trial_primes.size(); ++j) {
+                if (trial_primes[j] % d == 1) try_prime(trial_primes[j]);
+            }
+        } else {
+            primesieve::iterator it;
+            for (uint64_t p = it.next_prime(); p < trial_limit; p = it.next_prime()) {
+                if (p % d == 1) try_prime(p);
+            }
+        }
+    } else { //step through 1 (mod d)
+        mpz_class candidate;
+        for (uint64_t p = d + 1; p < trial_limit && p > d; p += d) {
+            if (!segmented_trial) {
+                if (binary_search(trial_primes.begin(), trial_primes.end(), (uint32_t) p)) try_prime(p);
+            } else {
+                candidate = (unsigned long) p;
+                if (mpz_probab_prime_p(candidate.get_mpz_t(), 25)) try_prime(p);
+            }
+        }
+    }
+
+    factors.merge(); //sorts factors and merges any <p,x>,<p,y> into <p,x+y>
+}
+
+//state shared by the threads scanning the exponent range
+
+typedef struct {
     mpz_class base;
-    base.set_str(argv[1], 10);
-    int min = atoi(argv[2]);
-    int max = atoi(argv[3]);
-    int skip;
-    if (argc >= 5) {
-        skip = atoi(argv[4]);
-    } else {
-        skip = 2;
+    FactorList base_factors; //factored once, then scaled by each exponent
+    vector<int> exponents;
+    atomic<size_t> next_exponent;
+    mutex output_mutex;
+    vector<ResultRecord> results; //per exponent: the log record if abundant
+    vector<bool> abundant;
+    vector<bool> done;
+    size_t next_output; //results are written in exponent order as soon as they are contiguous
+    ResultWriter writer; //opened at the first abundant exponent, so no hits leave no file
+    string output_filename;
+    ResultWriter::Format output_format;
+    unsigned sync_interval;
+
+    //cyclotomic mode: base = q^m, so index 1 of base^i is (q^(m*i) - 1)/(q - 1) = product over 1 < d | m*i of Phi_d(q)
+    bool cyclotomic;
+    mpz_class cyclotomic_base; //q
+    int cyclotomic_power; //m
+    uint64_t max_cached_d; //a larger d divides no other exponent of the range, so is not kept
+    map<uint64_t, FactorList> cyclotomic_cache; //d -> trial factors of Phi_d(q)
+    mutex cache_mutex;
+
+    FactorCache * factor_cache; //on-disk results shared with earlier runs and the other tools, or NULL
+    bool base_complete; //base_factors multiply to base, so index 1 is the one the other tools use
+} ScanData;
+
+//looks <number> of the given kind up in the on-disk cache, returning true if it holds all its trial factors
+
+bool cached_factors(ScanData & data, FactorCache::Kind kind, const mpz_class & base, uint64_t number, FactorList & factors) {
+    if (!data.factor_cache) return false;
+    FactorList cached;
+    if (data.factor_cache->lookup(kind, base, mpz_class((unsigned long) number), trial_limit, cached) < trial_limit) return false;
+    factors.swap(cached);
+    return true;
+}
+
+void cache_factors(ScanData & data, FactorCache::Kind kind, const mpz_class & base, uint64_t number, const FactorList & factors) {
+    if (data.factor_cache) data.factor_cache->append(kind, base, mpz_class((unsigned long) number), trial_limit, factors);
+}
+
+//returns the trial factors of index 1 of <base>^<i> in <factors>, assembled from the factors of each Phi_d(q)
+
+void index_one_factor(ScanData & data, int i, FactorList & factors) {
+    uint64_t n = (uint64_t) data.cyclotomic_power * i;
+    vector<uint64_t> primes = distinct_primes(n);
+
+    //divisors of n above 1
+    vector<uint64_t> divisors(1, 1);
+    for (vector<uint64_t>::size_type j = 0; j < primes.size(); ++j) {
+        vector<uint64_t>::size_type count = divisors.size();
+        for (uint64_t power = primes[j]; n % power == 0; power *= primes[j]) {
+            for (vector<uint64_t>::size_type k = 0; k < count; ++k) divisors.push_back(divisors[k] * power);
+        }
     }
 
-    precalc_trial_primes();
+    factors.clear();
+    FactorList phi_factors;
+    for (vector<uint64_t>::size_type j = 1; j < divisors.size(); ++j) {
+        uint64_t d = divisors[j];
+        {
+            lock_guard<mutex> lock(data.cache_mutex);
+            map<uint64_t, FactorList>::const_iterator cached = data.cyclotomic_cache.find(d);
+            if (cached != data.cyclotomic_cache.end()) {
+                factors.merge(cached->second);
+                continue;
+            }
+        }
+        if (!cached_factors(data, FactorCache::CYCLOTOMIC, data.cyclotomic_base, d, phi_factors)) {
+            cyclotomic_factor(data.cyclotomic_base, d, phi_factors);
+            cache_factors(data, FactorCache::CYCLOTOMIC, data.cyclotomic_base, d, phi_factors);
+        }
+        factors.merge(phi_factors);
+        if (d <= data.max_cached_d) {
+            lock_guard<mutex> lock(data.cache_mutex);
+            data.cyclotomic_cache[d] = phi_factors;
+        }
+    }
+}
+
+//checks the aliquot sequence of <base>^<i> for abundance of index 1, filling in <record> if it is
 
-    FactorVector factors; //vector<pair<p_i,x_i> >, n = product(p_i^x_i)
+bool check_exponent(ScanData & data, int i, ResultRecord & record) {
+    FactorList factors = data.base_factors; //n = product(p_i^x_i)
     mpz_class n, s, partial;
 
-    FactorVector::size_type j;
-    for (int i = min; i <= max; i += skip) {
+    if (data.base_complete && cached_factors(data, FactorCache::INDEX_ONE, data.base, i, factors)) {
+        // Index 1 -> 2 from an earlier run
+    } else if (data.cyclotomic) { // Index 0 -> 2 without forming index 1
+        index_one_factor(data, i, factors);
+        if (data.base_complete) cache_factors(data, FactorCache::INDEX_ONE, data.base, i, factors);
+    } else {
         // Index 0 -> 1
-        factor(base, factors);
-        for (j = 0; j < factors.size(); ++j) {
-            factors[j].second *= i;
-        }
-        sigma(factors, s, partial); //calculate sigma(n) and partial = product(factors)
+        factors.power(i);
+        factors.sigma(s, partial); //calculate sigma(n) and partial = product(factors)
         n = s - partial;
 
         // Index 1 -> 2
         factor(n, factors);
-        sigma(factors, s, partial); //calculate sigma(n) and partial = product(factors)
-        n = s - partial;
+        if (data.base_complete) cache_factors(data, FactorCache::INDEX_ONE, data.base, i, factors);
+    }
+    // Check for abundance of partial factors.
+    double abundance;
+    if (isAbundant(factors, abundance)) {
+        record.layout = ResultRecord::ABUNDANT_EXPONENT;
+        record.base = data.base;
+        record.exponent = i;
+        record.factors.swap(factors);
+        record.limit = trial_limit;
+        record.hasAbundance = true;
+        record.abundant = true;
+        record.abundance = abundance;
+        return true;
+    }
+    return false;
+}
+
+void scan_exponents(ScanData * data) {
+    size_t k;
+    while ((k = data->next_exponent++) < data->exponents.size()) {
+        ResultRecord record;
+        bool abundant = check_exponent(*data, data->exponents[k], record);
 
-        // Check for abundance of partial factors.
-        if (n > partial) {
-            ofstream fff("power_abundant_exponents", ios::app);
-            if (!fff.is_open()) {
+        lock_guard<mutex> lock(data->output_mutex);
+        swap(data->results[k], record);
+        data->abundant[k] = abundant;
+        data->done[k] = true;
+        for (; data->next_output < data->exponents.size() && data->done[data->next_output]; data->next_output++) {
+            if (!data->abundant[data->next_output]) continue;
+            if (!data->writer.isOpen() && !data->writer.open(data->output_filename, data->output_format, data->sync_interval)) {
                 cout << "WARNING: couldn't open output file for writing!" << endl;
-                return 1;
+                exit(1);
             }
-            string factorization = "";
-            for (j = 0; j < factors.size(); ++j) {
-                if (j) factorization += " * ";
-                factorization += factors[j].first.get_str() + (factors[j].second > 1 ? ("^" + to_string(factors[j].second)) : "");
+            data->writer.write(data->results[data->next_output]); //the writer takes the record, leaving it empty
+            cout << data->base.get_str() << "^" << data->exponents[data->next_output] << " is abundant!" << endl;
+        }
+    }
+}
+
+//the index 1 values sigma(<base>^i) - <base>^i for i = <min>, <min> + 2, ..., up to <count> of them
+
+vector<mpz_class> index_one_values(const mpz_class & base, int min, int count) {
+    FactorList base_factors;
+    factor(base, base_factors);
+    vector<mpz_class> values;
+    mpz_class s, n;
+    for (int i = min; (int) values.size() < count; i += 2) {
+        FactorList factors = base_factors;
+        factors.power(i);
+        factors.sigma(s, n);
+        values.push_back(s - n);
+    }
+    return values;
+}
+
+//times the kernels on fixed inputs, single threaded, for --bench; a candidate is one trial prime tried
+//on one number, or for sigma one number
+
+void run_benchmarks() {
+    Benchmark bench("powerAbundance");
+
+    {
+        FactorList base_factors;
+        base_factors.add((uint64_t) 2);
+        base_factors.add((uint64_t) 3);
+        base_factors.add((uint64_t) 5);
+        bench.run("sigma", "compositeBase", 1000, [&] {
+            mpz_class s, partial;
+            for (int i = 1; i <= 1000; ++i) {
+                FactorList factors = base_factors;
+                factors.power(i);
+                factors.sigma(s, partial);
             }
-            fff << base.get_str() << " " << i << " (" << factorization << ")" << endl;
-            fff.close();
-            cout << base.get_str() << "^" << i << " is abundant!" << endl;
+        });
+    }
+
+    //default limit, a deep limit kept in tables, and one past MAX_TABLE_LIMIT generated batch by batch
+    struct {
+        const char *name;
+        uint64_t limit;
+        int count;
+    } cases[] = {
+        { "defaultLimit",   DEFAULT_TRIAL_LIMIT, 200 },
+        { "deepLimit",      1000000,  20 },
+        { "segmentedLimit", 20000000, 2 }
+    };
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c) {
+        trial_limit = cases[c].limit;
+        precalc_trial_primes(true);
+        vector<mpz_class> values = index_one_values(3, 1001, cases[c].count);
+        uint64_t primes = trial_primes.size();
+        if (segmented_trial) {
+            primesieve::iterator it;
+            for (primes = 0; it.next_prime() < trial_limit; ++primes);
         }
+        bench.run("factor", cases[c].name, primes * values.size(), [&] {
+            FactorList factors;
+            for (size_t j = 0; j < values.size(); ++j) factor(values[j], factors);
+        });
+    }
+
+    trial_limit = 1000000;
+    precalc_trial_primes(true);
+    {
+        mpz_class q = 3;
+        vector<uint64_t> ds;
+        uint64_t steps = 0; //each d tries the numbers 1 (mod d) below the limit
+        for (uint64_t d = 1001; d < 1401; d += 2) {
+            ds.push_back(d);
+            steps += (trial_limit - 2) / d;
+        }
+        bench.run("cyclotomic_factor", "deepLimit", steps, [&] {
+            FactorList factors;
+            for (size_t j = 0; j < ds.size(); ++j) cyclotomic_factor(q, ds[j], factors);
+        });
+    }
+}
+
+enum { OPT_BENCH = 256 }; //codes for long-only options
+
+int main(int argc, char ** argv) {
+    const Arg_parser::Option options[] = {
+        { 't', "threadCount", Arg_parser::yes },
+        { 'l', "limit",       Arg_parser::yes },
+        { 'c', "cyclotomic",  Arg_parser::no  },
+        { 'f', "factorCache", Arg_parser::yes },
+        { 'o', "output",      Arg_parser::yes },
+        { 'j', "json",        Arg_parser::no  },
+        { 's', "sync",        Arg_parser::yes },
+        { OPT_BENCH, "bench", Arg_parser::no  },
+        {   0, 0,             Arg_parser::no  }
+    };
+
+    const Arg_parser parser(argc, argv, options);
+    if (parser.error().size()) {
+        cerr << "Argument error: " << parser.error() << endl;
+        return 1;
+    }
+
+    unsigned long thread_count = 1;
+    bool cyclotomic = false;
+    string cache_filename = "";
+    string output_filename = "power_abundant_exponents";
+    ResultWriter::Format output_format = ResultWriter::TEXT;
+    unsigned sync_interval = 0;
+    int argind;
+    for (argind = 0; argind < parser.arguments(); ++argind) {
+        const int code = parser.code(argind);
+        if (!code) break;
+        switch (code) {
+            case 't': thread_count = stol(parser.argument(argind)); break;
+            case 'l': trial_limit = stoull(parser.argument(argind)); break;
+            case 'c': cyclotomic = true; break;
+            case 'f': cache_filename = parser.argument(argind); break;
+            case 'o': output_filename = parser.argument(argind); break;
+            case 'j': output_format = ResultWriter::JSON_LINES; break;
+            case 's': sync_interval = stoul(parser.argument(argind)); break;
+            case OPT_BENCH: run_benchmarks(); return 0;
+            default:
+                cerr << "Uncaught option: " << code << endl;
+        }
+    }
+
+    if (parser.arguments() - argind < 3) {
+        print_help();
+        return 1;
+    }
+
+    ScanData data;
+    data.base.set_str(parser.argument(argind), 10);
+    int min = atoi(parser.argument(argind + 1).c_str());
+    int max = atoi(parser.argument(argind + 2).c_str());
+    int skip;
+    if (parser.arguments() - argind >= 4) {
+        skip = atoi(parser.argument(argind + 3).c_str());
+    } else {
+        skip = 2;
+    }
+
+    precalc_trial_primes();
+
+    factor(data.base, data.base_factors);
+
+    FactorCache factor_cache;
+    data.factor_cache = NULL;
+    if (!cache_filename.empty()) {
+        if (!factor_cache.open(cache_filename)) {
+            cerr << "ERROR: couldn't open factor cache " << cache_filename << endl;
+            return 2;
+        }
+        data.factor_cache = &factor_cache;
+    }
+    mpz_class base_product;
+    data.base_factors.product(base_product);
+    data.base_complete = base_product == data.base;
+
+    data.cyclotomic = false;
+    if (cyclotomic) {
+        if (data.base_factors.size() == 1 && data.base_complete) {
+            data.cyclotomic = true;
+            data.cyclotomic_base = data.base_factors.prime(0);
+            data.cyclotomic_power = data.base_factors.multiplicity(0);
+            data.max_cached_d = max > 0 ? (uint64_t) data.cyclotomic_power * max / 2 : 0;
+        } else {
+            cout << "WARNING: cyclotomic mode needs a prime power base; factoring index 1 directly" << endl;
+        }
+    }
+
+    for (int i = min; i <= max; i += skip) {
+        data.exponents.push_back(i);
+    }
+    data.next_exponent = 0;
+    data.results.resize(data.exponents.size());
+    data.abundant.assign(data.exponents.size(), false);
+    data.output_filename = output_filename;
+    data.output_format = output_format;
+    data.sync_interval = sync_interval;
+    data.done.assign(data.exponents.size(), false);
+    data.next_output = 0;
+
+    vector<thread> threads;
+    for (unsigned long t = 0; t < thread_count; ++t) {
+        threads.push_back(thread(scan_exponents, &data));
+    }
+    for (vector<thread>::size_type t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+    if (!data.writer.close()) {
+        cout << "WARNING: couldn't write output file!" << endl;
+        return 1;
     }
     return 0;
 }
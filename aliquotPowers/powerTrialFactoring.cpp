@@ -12,295 +12,1514 @@
 
 #include <cstdint>
 #include <cstdlib>
+#include <climits>
 #include <vector>
+#include <algorithm>
 #include <string>
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <cmath>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <map>
+#include <chrono>
+#include <cstdio>
+#include <cinttypes>
+#include <ctime>
 
+#include <unistd.h>
 #include <pthread.h>
 
 #include <gmpxx.h>
 #include <primesieve.hpp>
 
 #include "arg_parser.h"
+#include "montgomery.h"
+#include "factorlist.h"
+#include "factorcache.h"
+#include "resultwriter.h"
+#include "abundance.h"
+#include "benchmark.h"
+#include "factorengine.h"
+#include "powerfilter.h"
 
 using namespace std;
 
-// Factor typedef
-typedef pair<mpz_class, uint64_t> Factor;
+// Validate a number string
+bool isnumber(string s) {
+    for (string::size_type j = 0; j < s.size(); ++j) {
+        if (s[j] < '0' || s[j] > '9') return false;
+    }
+    return true;
+}
+
+// Parse a factor (with exponent) string into the factor list, merged
+void parseFactors(FactorList & factors, string factorString) {
+    if (!factors.parse(factorString)) {
+        cerr << "not a number: " << factorString << endl;
+        exit(1);
+    }
+    factors.merge();
+}
+
+// Parse an exponent given as a number or a product of prime powers, keeping those terms in exponentFactors
+void parseExponent(mpz_class & exponent, string exponentString, FactorList & exponentFactors) {
+    parseFactors(exponentFactors, exponentString);
+    exponentFactors.product(exponent);
+}
+
+// The same, for callers with no use for the terms
+void parseExponent(mpz_class & exponent, string exponentString) {
+    FactorList exponentFactors;
+    parseExponent(exponent, exponentString, exponentFactors);
+}
+
+// Factor n completely (trial division, then Pollard rho and P-1), or exit: the index 1 test is only correct
+// for the full factorization of the base
+void simpleFactor(mpz_class n, FactorList & factors, const FactoringBounds & bounds) {
+    mpz_class cofactor;
+    if (!factorCompletely(n, bounds, factors, cofactor)) {
+        cerr << "ERROR: couldn't factor " << n << " completely; composite cofactor " << cofactor << " is left" << endl
+             << "       (raise --rho or --pm1 to search further)" << endl;
+        exit(1);
+    }
+}
+
+// The factor cache holds the factors of index 1 proper, sigma(base^exponent) - base^exponent, which is
+// the number tested here only when the base is squarefree and fully factored
+bool cacheableBase(mpz_class & base, FactorList & baseFactors) {
+    for (size_t i = 0; i < baseFactors.size(); i++) {
+        if (baseFactors.multiplicity(i) != 1) {
+            return false;
+        }
+    }
+    mpz_class product;
+    baseFactors.product(product);
+    return product == base;
+}
+
+// Precomputed data for testing whether a prime power divides index 1 of base^exponent
+typedef struct {
+    mpz_class base;
+    FactorList baseFactors;
+    vector<mpz_class> basePrimes; // the primes of baseFactors, for the GMP path
+    mpz_class divisor;
+    mpz_class exponent;
+    mpz_class exponentPlusOne;
+    // Word-sized copies for the Montgomery fast path, valid if wordBase is set
+    bool wordBase;
+    uint64_t baseWord;
+    vector<uint64_t> basePrimeWords;
+    bool wordDivisor;
+    uint128_t divisorWord;
+    vector<uint64_t> exponentLimbs;
+    vector<uint64_t> exponentPlusOneLimbs;
+    bool primeBase; // then index 1 is (b^e - 1) / (b - 1), and multiplicities come from lifting the exponent
+    // Prime factors (with multiplicity) of the exponent below the factoring limit, for sieving candidates
+    bool sieveCandidates;
+    vector<pair<uint64_t, uint64_t> > exponentPrimes;
+    // Screening of the primes below 2^32 modulo the prime alone, used if screenKernel is set
+    PowerFilterKernel screenKernel;
+    PowerFilterData screen;
+} IndexOneTest;
+
+// Room for a modulus of the divisor times the square of a prime below 2^64, and for products of two residues
+#define WORKSPACE_PRIME_BITS 128
+
+// One thread's temporaries for the GMP divisibility test. They are allocated once, large enough for the
+// moduli it meets, so that testing a prime allocates nothing; a larger prime power just grows them.
+class IndexOneWorkspace {
+public:
+    mpz_t candidate; // the prime power under test
+    mpz_t modulus;
+    mpz_t power;
+    mpz_t firstAddend;
+    mpz_t product;
+    vector<uint64_t> primeResidues; // the base's primes modulo a word modulus, for a base too large for a word
+
+    IndexOneWorkspace(const mpz_class & divisor) {
+        mp_bitcnt_t modulusBits = mpz_sizeinbase(divisor.get_mpz_t(), 2) + WORKSPACE_PRIME_BITS;
+        mpz_init2(candidate, WORKSPACE_PRIME_BITS);
+        mpz_init2(modulus, modulusBits);
+        mpz_init2(power, modulusBits);
+        mpz_init2(firstAddend, 2 * modulusBits);
+        mpz_init2(product, 2 * modulusBits);
+    }
+
+    ~IndexOneWorkspace() {
+        mpz_clears(candidate, modulus, power, firstAddend, product, NULL);
+    }
+
+private:
+    IndexOneWorkspace(const IndexOneWorkspace &);
+    IndexOneWorkspace & operator=(const IndexOneWorkspace &);
+};
+
+// Shared chunk counter; chunks are claimed with a compare-and-swap, so no thread ever waits on another
+typedef struct {
+    atomic<uint64_t> nextStart;
+    uint64_t firstStart;
+    uint64_t factoringLimit;
+    uint64_t threadCount;
+} ChunkScheduler;
+
+// Settings for periodic checkpoints of a fullFactor run
+typedef struct {
+    string filename;
+    uint64_t interval; // seconds between checkpoints
+    bool resume;
+} CheckpointSettings;
+
+// Chunks complete out of order, so track the lowest boundary below which every chunk is done
+typedef struct {
+    mutex frontierMutex;
+    uint64_t frontier;
+    map<uint64_t, pair<uint64_t, FactorList> > pendingChunks; // start -> (finish, factors) of chunks done above the frontier
+    FactorList committedFactors; // factors of every prime below the frontier
+    CheckpointSettings *settings;
+    mutex checkpointMutex; // serializes writers, so an older snapshot never replaces a newer one
+    uint64_t checkpointFrontier;
+    IndexOneTest *test;
+    uint64_t factoringLimit;
+    chrono::steady_clock::time_point lastCheckpoint;
+} ChunkFrontier;
+
+// Running abundance of the factors found so far, for stopping as soon as index 1 is known to be abundant
+typedef struct {
+    mutex abundanceMutex;
+    FactorList factors;
+    AbundanceBound bound;
+    atomic<bool> reached;
+    uint64_t abundantPrime; // the prime whose factor established abundance
+} AbundanceTracker;
+
+// Settings for live progress reports
+typedef struct {
+    uint64_t interval; // seconds between reports
+    string statusFilename; // rewritten with every report if set, instead of printing to standard error
+} ProgressSettings;
+
+// Counters of one worker thread. Only the thread itself writes them, once per chunk, so relaxed stores
+// suffice; each sits on its own cache line, so no two threads' updates contend. Nothing is counted per
+// prime, which would slow the loop over the primes measurably, so primesTested is estimated from the bounds
+// of the chunks done.
+struct alignas(64) ThreadProgress {
+    atomic<double> primesTested{0};
+    atomic<uint64_t> factorsFound{0};
+    atomic<uint64_t> chunkStart{0}; // the chunk in hand is [chunkStart, chunkFinish); between chunks, both are
+    atomic<uint64_t> chunkFinish{0}; // the last one's finish, and the factoring limit once the thread is done
+    atomic<uint64_t> cpuNanoseconds{0}; // CPU time of the thread, set once it is done
+};
+
+// Progress of a run, reported by a separate thread every interval
+typedef struct {
+    ProgressSettings *settings;
+    ChunkScheduler *scheduler;
+    unique_ptr<ThreadProgress[]> threads;
+    vector<clockid_t> threadClocks; // CPU time clocks of the workers, read by the reporter for their utilization
+    vector<bool> threadClockValid; // cleared under stopMutex just before the worker is joined
+    uint64_t threadCount;
+    uint64_t start;
+    uint64_t factoringLimit;
+    chrono::steady_clock::time_point startTime;
+    mutex stopMutex;
+    condition_variable stopSignal;
+    bool stopping;
+} ProgressMonitor;
+
+typedef struct {
+    IndexOneTest *test;
+    ChunkScheduler *scheduler;
+    ChunkFrontier *frontier; // only when checkpointing
+    AbundanceTracker *abundance; // only when stopping early
+    ProgressMonitor *progress; // only when reporting progress
+    vector<FactorList> threadFactors; // one result list per thread, merged at the end
+} FullFactorData;
+
+// The lane-parallel screening kernels for primes below 2^32, by shape of base: the widest build this CPU
+// runs unless --filter says otherwise; NULL tests every prime exactly
+const PowerFilterKernel *powerFilters = powerFilterKernels(bestPowerFilter());
+
+#define MIN_CHUNK_WIDTH 1000
+#define CHUNK_PRIMES 2048
+
+void initChunkScheduler(ChunkScheduler & scheduler, uint64_t start, uint64_t factoringLimit, uint64_t threadCount) {
+    scheduler.nextStart = start;
+    scheduler.firstStart = start;
+    scheduler.factoringLimit = factoringLimit;
+    scheduler.threadCount = threadCount;
+}
+
+// Chunk width for a chunk starting at start: about CHUNK_PRIMES primes, since primes thin out
+// like 1/log(start), but small enough to leave every thread several chunks to balance the load
+uint64_t chunkWidth(ChunkScheduler & scheduler, uint64_t start) {
+    uint64_t width = (uint64_t) (CHUNK_PRIMES * log((double) max(start, (uint64_t) 3)));
+    uint64_t balancedWidth = (scheduler.factoringLimit - scheduler.firstStart) / (scheduler.threadCount * 8);
+    width = min(width, balancedWidth);
+    return max(width, (uint64_t) MIN_CHUNK_WIDTH);
+}
+
+// Claim the next chunk [start, finish) below the factoring limit
+bool nextChunk(ChunkScheduler & scheduler, uint64_t & start, uint64_t & finish) {
+    start = scheduler.nextStart.load(memory_order_relaxed);
+    do {
+        if (start >= scheduler.factoringLimit) {
+            return false;
+        }
+        finish = min(start + chunkWidth(scheduler, start), scheduler.factoringLimit);
+    } while (!scheduler.nextStart.compare_exchange_weak(start, finish, memory_order_relaxed));
+    return true;
+}
+
+// Calculate the product of (p - 1) over the base factors
+mpz_class computeDivisor(FactorList & baseFactors) {
+    mpz_class divisor = 1;
+
+    for (size_t i = 0; i < baseFactors.size(); i++) {
+        mpz_class factorMinusOne = baseFactors.prime(i) - 1;
+        for (uint64_t j = 0; j < baseFactors.multiplicity(i); j++) {
+            divisor *= factorMinusOne;
+        }
+    }
+
+    return divisor;
+}
+
+// Split a nonnegative number into little-endian 64-bit limbs
+vector<uint64_t> toLimbs(const mpz_class & n) {
+    vector<uint64_t> limbs((mpz_sizeinbase(n.get_mpz_t(), 2) + 63) / 64);
+    mpz_export(limbs.data(), NULL, -1, sizeof(uint64_t), 0, 0, n.get_mpz_t());
+    return limbs;
+}
+
+// Fill in the divisibility test data for base^exponent
+void initIndexOneTest(IndexOneTest & test, mpz_class & base, FactorList & baseFactors, mpz_class & exponent) {
+    test.base = base;
+    test.baseFactors = baseFactors;
+    test.basePrimes.clear();
+    for (size_t i = 0; i < baseFactors.size(); i++) {
+        test.basePrimes.push_back(baseFactors.prime(i));
+    }
+    test.divisor = computeDivisor(baseFactors);
+    test.exponent = exponent;
+    test.exponentPlusOne = exponent + 1;
+
+    test.wordBase = mpz_sizeinbase(base.get_mpz_t(), 2) <= 64;
+    test.baseWord = test.wordBase ? mpz_get_ui(base.get_mpz_t()) : 0; // then every base factor is a word too
+    test.basePrimeWords.clear();
+    for (size_t i = 0; test.wordBase && i < baseFactors.size(); i++) {
+        test.basePrimeWords.push_back(baseFactors.word(i));
+    }
+    test.wordDivisor = mpz_sizeinbase(test.divisor.get_mpz_t(), 2) <= 128;
+    test.divisorWord = 0;
+    if (test.wordDivisor) {
+        vector<uint64_t> divisorLimbs = toLimbs(test.divisor);
+        for (vector<uint64_t>::size_type i = divisorLimbs.size(); i-- > 0;) {
+            test.divisorWord = (test.divisorWord << 64) | divisorLimbs[i];
+        }
+    }
+    test.exponentLimbs = toLimbs(exponent);
+    test.exponentPlusOneLimbs = toLimbs(test.exponentPlusOne);
+    test.primeBase = baseFactors.size() == 1 && baseFactors.multiplicity(0) == 1 && test.basePrimes[0] == base;
+    test.sieveCandidates = false;
 
-// Convert Factor typedef to string
-string factorToString(Factor & factor) {
-    if (factor.second == 1) {
-        return factor.first.get_str();
+    // The screen works with the same word-sized base as the Montgomery path
+    test.screenKernel = NULL;
+    if (powerFilters && test.wordBase && test.wordDivisor && baseFactors.size() <= POWER_FILTER_MAX_BASE_PRIMES && exponent > 0) {
+        test.screen.exponentLimbs = test.exponentLimbs.data();
+        test.screen.exponentLimbCount = test.exponentLimbs.size();
+        test.screen.basePrimeCount = baseFactors.size();
+        for (size_t i = 0; i < baseFactors.size(); i++) {
+            test.screen.basePrimes[i] = baseFactors.word(i);
+            test.screen.multiplicities[i] = baseFactors.multiplicity(i);
+        }
+        test.screen.divisorLow = (uint64_t) test.divisorWord;
+        test.screen.divisorHigh = (uint64_t) (test.divisorWord >> 64);
+        test.screenKernel = powerFilters[powerFilterShape(test.screen)];
+    }
+}
+
+// Find the prime factors of the exponent which are below the factoring limit, starting from its terms as
+// given (exponentFactors, or the exponent itself if NULL). A term is trial divided only while the next prime
+// is at most its square root, and not at all once it is a probable prime, so a large prime exponent costs
+// nothing here.
+void factorExponent(const mpz_class & exponent, const FactorList *exponentFactors, uint64_t factoringLimit, vector<pair<uint64_t, uint64_t> > & exponentPrimes) {
+    vector<pair<mpz_class, uint64_t> > terms;
+    if (exponentFactors) {
+        for (size_t i = 0; i < exponentFactors->size(); i++) {
+            terms.push_back(make_pair(exponentFactors->prime(i), exponentFactors->multiplicity(i)));
+        }
     } else {
-        return factor.first.get_str() + "^" + to_string(factor.second);
+        terms.push_back(make_pair(exponent, (uint64_t) 1));
+    }
+
+    map<uint64_t, uint64_t> primes; // terms may share primes
+    mpz_class root;
+    for (vector<pair<mpz_class, uint64_t> >::size_type i = 0; i < terms.size(); i++) {
+        mpz_class & n = terms[i].first;
+        uint64_t termMultiplicity = terms[i].second;
+        if (n < 2) {
+            continue;
+        }
+        bool done = mpz_probab_prime_p(n.get_mpz_t(), 25);
+        mpz_sqrt(root.get_mpz_t(), n.get_mpz_t());
+        primesieve::iterator it;
+        for (uint64_t prime = it.next_prime(); !done && prime < factoringLimit && mpz_cmp_ui(root.get_mpz_t(), prime) >= 0; prime = it.next_prime()) {
+            uint64_t multiplicity = 0;
+            while (mpz_divisible_ui_p(n.get_mpz_t(), prime)) {
+                mpz_divexact_ui(n.get_mpz_t(), n.get_mpz_t(), prime);
+                multiplicity++;
+            }
+            if (multiplicity) {
+                primes[prime] += multiplicity * termMultiplicity;
+                mpz_sqrt(root.get_mpz_t(), n.get_mpz_t());
+                done = n == 1 || mpz_probab_prime_p(n.get_mpz_t(), 25);
+            }
+        }
+
+        // What is left is 1, a prime, or a number with no prime factors below the limit
+        if (n > 1 && n < factoringLimit) {
+            primes[mpz_get_ui(n.get_mpz_t())] += termMultiplicity;
+        }
+    }
+    exponentPrimes.assign(primes.begin(), primes.end());
+}
+
+// Enable the candidate sieve, which is only valid for a prime base, where index 1 is (b^e - 1)/(b - 1)
+void initCandidateSieve(IndexOneTest & test, uint64_t factoringLimit, const FactorList *exponentFactors) {
+    test.sieveCandidates = test.primeBase;
+    if (test.sieveCandidates) {
+        factorExponent(test.exponent, exponentFactors, factoringLimit, test.exponentPrimes);
     }
 }
 
-// Write string for factor vector
-string getBaseFactorString(vector<Factor> & factors) {
-    ostringstream ss;
-    for (vector<Factor>::size_type i = 0; i < factors.size(); i++) {
-        if (i) {
-            ss << " * ";
+// Decide without any exponentiation whether a prime not dividing b(b - 1) can divide index 1 of a prime
+// base. Such a prime divides b^e - 1 only if the order of b mod p, which divides g = gcd(e, p - 1), is
+// more than 1. So g == 1 rules the prime out, and g == 2 requires b == -1 mod p.
+bool mayDivideIndexOne(IndexOneTest & test, uint64_t prime) {
+    uint64_t g = 1;
+    uint64_t primeMinusOne = prime - 1;
+    for (vector<pair<uint64_t, uint64_t> >::size_type i = 0; i < test.exponentPrimes.size(); i++) {
+        uint64_t r = test.exponentPrimes[i].first;
+        for (uint64_t k = 0; k < test.exponentPrimes[i].second && primeMinusOne % r == 0; k++) {
+            primeMinusOne /= r;
+            g *= r;
+            if (g > 2) {
+                return true;
+            }
         }
-        ss << factorToString(factors[i]);
     }
-    return ss.str();
+
+    uint64_t baseResidue = test.wordBase ? test.baseWord % prime : mpz_fdiv_ui(test.base.get_mpz_t(), prime);
+    if (baseResidue <= 1) {
+        return true; // p divides b or b - 1; leave it to the full test
+    }
+    return g == 2 && baseResidue == prime - 1;
 }
 
-// Push new factor to vector
-void foundFactor(vector<Factor> & factors, mpz_class factor, uint64_t exponent = 1) {
-    factors.push_back(make_pair(factor, exponent));
+// Index 1 is S = product((p_i^(e+1) - 1)^k_i) / divisor - b^e, and the tests below check the difference
+// F - b^e * divisor of the first term times divisor. Modulo divisor * prime^k, that is the same as prime^k
+// dividing S. When the prime doesn't divide the divisor, the divisor is invertible modulo prime^k, so by the
+// CRT that is also the same as F = b^e * divisor (mod prime^k), and the divisor drops out of the modulus.
+bool divisorCoprime(IndexOneTest & test, uint64_t prime) {
+    if (test.wordDivisor && (test.divisorWord >> 64) == 0) {
+        return (uint64_t) test.divisorWord % prime != 0;
+    }
+    return mpz_fdiv_ui(test.divisor.get_mpz_t(), prime) != 0;
 }
 
-// Validate a number string
-bool isnumber(string s) {
-    for (string::size_type j = 0; j < s.size(); ++j) {
-        if (s[j] < '0' || s[j] > '9') return false;
+// Test divisibility with word arithmetic, for a modulus (prime^k, or divisor * prime^k) that fits in a Word,
+// given the base's primes, the base and the divisor modulo it (or any numbers congruent to them).
+// The test is a congruence to zero, so the odd part of the modulus (in Montgomery form) and
+// the power-of-two part (wrapping arithmetic) can be checked separately.
+template <typename Word>
+bool dividesIndexOneWord(IndexOneTest & test, Word modulus, const uint64_t *primeResidues, uint64_t baseResidue, Word divisorResidue) {
+    int twoPower = trailingZeros(modulus);
+    Word oddPart = modulus >> twoPower;
+
+    if (oddPart > 1) {
+        Montgomery<Word> mont(oddPart);
+        Word firstAddend = mont.one();
+        for (size_t i = 0; i < test.baseFactors.size(); i++) {
+            Word tmp = mont.power(mont.toMontgomery(primeResidues[i]), test.exponentPlusOneLimbs);
+            tmp = mont.subtract(tmp, mont.one());
+            firstAddend = mont.multiply(firstAddend, mont.power(tmp, test.baseFactors.multiplicity(i)));
+        }
+        Word secondAddend = mont.power(mont.toMontgomery(baseResidue), test.exponentLimbs);
+        secondAddend = mont.multiply(secondAddend, mont.toMontgomery(divisorResidue));
+        if (firstAddend != secondAddend) {
+            return false;
+        }
     }
+
+    if (twoPower > 0) {
+        Word firstAddend = 1;
+        for (size_t i = 0; i < test.baseFactors.size(); i++) {
+            Word tmp = wrapPower((Word) primeResidues[i], test.exponentPlusOneLimbs) - 1;
+            firstAddend *= wrapPower(tmp, test.baseFactors.multiplicity(i));
+        }
+        Word sum = firstAddend - wrapPower((Word) baseResidue, test.exponentLimbs) * divisorResidue;
+        Word mask = ((Word) 1 << twoPower) - 1;
+        if ((sum & mask) != 0) {
+            return false;
+        }
+    }
+
     return true;
 }
 
-// Parse a factor (with exponent) string and add it to the factor vector
-void parseExponent(vector<Factor> & factors, string exponentString) {
-    factors.clear();
-    string s;
-    stringstream ss(exponentString);
-    while (ss >> ws >> s) {
-        if (s == "*") continue;
-        string::size_type o;
-        if ((o = s.find('^')) != s.npos) {
-            string p = s.substr(0, o);
-            string e = s.substr(o + 1);
-            if (!isnumber(p) || !isnumber(e)) {
-                cerr << "not a number: " << s << endl;
-                exit(1);
-            }
-            foundFactor(factors, mpz_class(p), stoi(e));
+// The word test modulo prime^k alone, for a prime not dividing the divisor. A word base is used as is (its
+// divisor is smaller still); a larger one is reduced into the workspace, for a 64-bit modulus only.
+template <typename Word>
+bool dividesIndexOneCoprime(IndexOneTest & test, IndexOneWorkspace & ws, Word modulus) {
+    if (test.wordBase) {
+        Word divisor = (Word) (uint64_t) test.divisorWord;
+        return dividesIndexOneWord<Word>(test, modulus, test.basePrimeWords.data(), test.baseWord, divisor < modulus ? divisor : divisor % modulus);
+    }
+    uint64_t wordModulus = (uint64_t) modulus;
+    ws.primeResidues.resize(test.basePrimes.size());
+    for (size_t i = 0; i < test.basePrimes.size(); i++) {
+        ws.primeResidues[i] = mpz_fdiv_ui(test.basePrimes[i].get_mpz_t(), wordModulus);
+    }
+    return dividesIndexOneWord<Word>(test, modulus, ws.primeResidues.data(), mpz_fdiv_ui(test.base.get_mpz_t(), wordModulus),
+                                     mpz_fdiv_ui(test.divisor.get_mpz_t(), wordModulus));
+}
+
+// Test whether the workspace's candidate (a prime power) divides index 1 of base^exponent, that is
+// whether product((p_i^(e+1) - 1)^k_i) = b^e * divisor (mod candidate, or divisor * candidate unless coprime)
+bool dividesIndexOne(IndexOneTest & test, IndexOneWorkspace & ws, bool coprime) {
+    if (coprime) {
+        mpz_set(ws.modulus, ws.candidate);
+    } else {
+        mpz_mul(ws.modulus, test.divisor.get_mpz_t(), ws.candidate);
+    }
+    mpz_set_ui(ws.firstAddend, 1);
+    for (size_t i = 0; i < test.baseFactors.size(); i++) {
+        // One exponentiation per distinct base factor; its multiplicity becomes a second, small exponent
+        mpz_powm(ws.power, test.basePrimes[i].get_mpz_t(), test.exponentPlusOne.get_mpz_t(), ws.modulus);
+        if (mpz_cmp_ui(ws.power, 0) == 0) { // we want to avoid negative numbers
+            mpz_sub_ui(ws.power, ws.modulus, 1);
+        } else if (mpz_cmp_ui(ws.power, 1) == 0) { // special case: the product will be 0 if a single factor is 0
+            mpz_set_ui(ws.firstAddend, 0);
+            break;
         } else {
-            if (!isnumber(s)) {
-                cerr << "not a number: " << s << endl;
-                exit(1);
+            mpz_sub_ui(ws.power, ws.power, 1);
+        }
+        if (test.baseFactors.multiplicity(i) > 1) {
+            mpz_powm_ui(ws.power, ws.power, test.baseFactors.multiplicity(i), ws.modulus);
+        }
+        mpz_mul(ws.product, ws.firstAddend, ws.power);
+        mpz_mod(ws.firstAddend, ws.product, ws.modulus);
+    }
+    mpz_powm(ws.power, test.base.get_mpz_t(), test.exponent.get_mpz_t(), ws.modulus);
+    mpz_mul(ws.product, ws.power, test.divisor.get_mpz_t());
+    mpz_sub(ws.product, ws.firstAddend, ws.product);
+    return mpz_divisible_p(ws.product, ws.modulus);
+}
+
+// Count how many powers of prime divide index 1, assuming the first (firstPower - 1) do, trying none past
+// lastPower
+int countPowers(IndexOneTest & test, IndexOneWorkspace & ws, uint64_t prime, int firstPower, int lastPower) {
+    int divideAmount = firstPower - 1;
+    bool coprime = divisorCoprime(test, prime);
+
+    if (coprime) {
+        // Stay in machine words while prime^k fits, in 128 bits for a word base and in 64 bits otherwise
+        uint128_t modulus = 1;
+        bool fits = true;
+        for (int k = 0; k < firstPower && fits; k++) {
+            fits = !__builtin_mul_overflow(modulus, (uint128_t) prime, &modulus);
+        }
+        while (fits && ((modulus >> 64) == 0 || test.wordBase) && divideAmount < lastPower) {
+            bool divides = (modulus >> 64) == 0 ? dividesIndexOneCoprime<uint64_t>(test, ws, (uint64_t) modulus) : dividesIndexOneCoprime<uint128_t>(test, ws, modulus);
+            if (!divides) {
+                return divideAmount;
+            }
+            divideAmount++;
+            fits = !__builtin_mul_overflow(modulus, (uint128_t) prime, &modulus);
+        }
+    } else if (test.wordBase && test.wordDivisor) {
+        // Stay in machine words while divisor * prime^k fits in 128 bits
+        uint128_t modulus = test.divisorWord;
+        bool fits = true;
+        for (int k = 0; k < firstPower && fits; k++) {
+            fits = !__builtin_mul_overflow(modulus, (uint128_t) prime, &modulus);
+        }
+        while (fits && divideAmount < lastPower) {
+            bool divides = (modulus >> 64) == 0 ?
+                dividesIndexOneWord<uint64_t>(test, (uint64_t) modulus, test.basePrimeWords.data(), test.baseWord, (uint64_t) test.divisorWord) :
+                dividesIndexOneWord<uint128_t>(test, modulus, test.basePrimeWords.data(), test.baseWord, test.divisorWord);
+            if (!divides) {
+                return divideAmount;
             }
-            foundFactor(factors, mpz_class(s));
+            divideAmount++;
+            fits = !__builtin_mul_overflow(modulus, (uint128_t) prime, &modulus);
         }
     }
+
+    if (divideAmount >= lastPower) {
+        return divideAmount;
+    }
+    mpz_ui_pow_ui(ws.candidate, prime, divideAmount + 1);
+    // the number could divide n and n² and n³...
+    while (divideAmount < lastPower && dividesIndexOne(test, ws, coprime)) {
+        divideAmount++;
+        mpz_mul_ui(ws.candidate, ws.candidate, prime);
+    }
+    return divideAmount;
 }
 
-// Sort the factor vector and merge common factors
-void merge_factors(vector<Factor> & factors) {
-    sort(factors.begin(), factors.end());
-    for (vector<Factor>::size_type j = 1; j < factors.size();) {
-        if (factors[j].first == factors[j - 1].first) {
-            factors[j - 1].second += factors[j].second;
-            factors.erase(factors.begin() + j);
-        } else {
-            ++j;
+// v_p(n) of a nonzero word
+static int wordValuation(uint128_t n, uint64_t prime) {
+    int valuation = 0;
+    for (; n % prime == 0; n /= prime) {
+        valuation++;
+    }
+    return valuation;
+}
+
+// The exact power of prime in index 1 = 1 + b + ... + b^(e-1) = (b^e - 1) / (b - 1) of a prime base b,
+// given that prime divides it (so it isn't b), by lifting the exponent instead of testing power after power
+int liftedValuation(IndexOneTest & test, IndexOneWorkspace & ws, uint64_t prime) {
+    if (prime == 2) {
+        // b is odd and e even, so v_2(b^e - 1) = v_2(b - 1) + v_2(b + 1) + v_2(e) - 1
+        mpz_add_ui(ws.product, test.base.get_mpz_t(), 1);
+        return mpz_scan1(ws.product, 0) + mpz_scan1(test.exponent.get_mpz_t(), 0) - 1;
+    }
+
+    // Write e = e' * p^t with p not dividing e'. The order of b mod p divides e and p - 1, hence e', so p
+    // divides b^e' - 1 and v_p(b^e - 1) = v_p(b^e' - 1) + t.
+    mpz_set_ui(ws.candidate, prime);
+    int t = 0;
+    mpz_class reducedExponent; // only needed when p divides e, which is rarer still
+    if (mpz_divisible_ui_p(test.exponent.get_mpz_t(), prime)) {
+        t = mpz_remove(reducedExponent.get_mpz_t(), test.exponent.get_mpz_t(), ws.candidate);
+    }
+
+    // v_p(b^e' - 1) from one residue of b^e', modulo the largest power of p that fits in 128 bits. It is
+    // nearly always 1; if every power there divides, GMP goes on with ever larger powers of p.
+    int valuation = 0;
+    if (test.wordBase && t == 0) {
+        uint128_t modulus = prime;
+        for (uint128_t next; !__builtin_mul_overflow(modulus, (uint128_t) prime, &next); modulus = next) {
+        }
+        Montgomery<uint128_t> mont(modulus);
+        uint128_t residue = mont.fromMontgomery(mont.power(mont.toMontgomery(test.baseWord), test.exponentLimbs));
+        valuation = residue == 1 ? 0 : wordValuation(residue - 1, prime);
+    }
+    for (unsigned long k = 2; valuation == 0; k *= 2) {
+        mpz_ui_pow_ui(ws.modulus, prime, k);
+        mpz_powm(ws.power, test.base.get_mpz_t(), t ? reducedExponent.get_mpz_t() : test.exponent.get_mpz_t(), ws.modulus);
+        mpz_sub_ui(ws.power, ws.power, 1);
+        if (mpz_sgn(ws.power) != 0) {
+            valuation = mpz_remove(ws.power, ws.power, ws.candidate);
         }
     }
+
+    // Less the power of p in b - 1
+    int divisorValuation;
+    if (test.wordBase) {
+        divisorValuation = wordValuation(test.baseWord - 1, prime);
+    } else {
+        mpz_sub_ui(ws.power, test.base.get_mpz_t(), 1);
+        divisorValuation = mpz_remove(ws.power, ws.power, ws.candidate);
+    }
+    return valuation + t - divisorValuation;
+}
+
+// Count how many powers of prime divide index 1, assuming the first (firstPower - 1) do
+int primeMultiplicity(IndexOneTest & test, IndexOneWorkspace & ws, uint64_t prime, int firstPower) {
+    if (!test.primeBase) {
+        return countPowers(test, ws, prime, firstPower, INT_MAX);
+    }
+    // For a prime base, only the prime itself needs testing; lifting the exponent gives the rest
+    if (firstPower == 1 && countPowers(test, ws, prime, 1, 1) == 0) {
+        return 0;
+    }
+    return liftedValuation(test, ws, prime);
 }
 
-// Perform simple trial factoring
-void simpleFactor(mpz_class n, vector<Factor> & factors, uint64_t factoringLimit) {
+#define CHECKPOINT_HEADER "powerTrialFactoring checkpoint"
+
+// Write a checkpoint atomically: to a temporary file, synced, then renamed over the old one
+bool saveCheckpoint(string filename, IndexOneTest & test, uint64_t factoringLimit, uint64_t frontier, FactorList & factors) {
+    string tmpFilename = filename + ".tmp";
+    FILE *file = fopen(tmpFilename.c_str(), "w");
+    if (file == NULL) {
+        return false;
+    }
+    fprintf(file, "%s\nbase %s\nexponent %s\nlimit %" PRIu64 "\nfrontier %" PRIu64 "\nfactors %s\n", CHECKPOINT_HEADER,
+            test.base.get_str().c_str(), test.exponent.get_str().c_str(), factoringLimit, frontier, factors.toString().c_str());
+    bool written = fflush(file) == 0 && fsync(fileno(file)) == 0;
+    written = fclose(file) == 0 && written;
+    return written && rename(tmpFilename.c_str(), filename.c_str()) == 0;
+}
+
+// Read a checkpoint written by saveCheckpoint
+bool loadCheckpoint(string filename, mpz_class & base, mpz_class & exponent, uint64_t & factoringLimit, uint64_t & frontier, FactorList & factors) {
+    ifstream file(filename);
+    if (!file.is_open()) {
+        return false;
+    }
+    string line, key, value;
+    getline(file, line);
+    if (line != CHECKPOINT_HEADER) {
+        return false;
+    }
+    bool haveFrontier = false;
     factors.clear();
-    if (mpz_probab_prime_p(n.get_mpz_t(), 25)) {
-        foundFactor(factors, n);
-        return;
+    while (getline(file, line)) {
+        string::size_type space = line.find(' ');
+        key = line.substr(0, space);
+        value = space == string::npos ? "" : line.substr(space + 1);
+        if (key == "base") {
+            base.set_str(value, 10);
+        } else if (key == "exponent") {
+            exponent.set_str(value, 10);
+        } else if (key == "limit") {
+            factoringLimit = stoull(value);
+        } else if (key == "frontier") {
+            frontier = stoull(value);
+            haveFrontier = true;
+        } else if (key == "factors") {
+            parseFactors(factors, value);
+        }
     }
+    return haveFrontier;
+}
 
-    primesieve::iterator it;
-    uint64_t prime = it.next_prime();
+// Hand a finished chunk's factors to the frontier, and write a checkpoint if one is due
+void completeChunk(ChunkFrontier & frontier, uint64_t start, uint64_t finish, FactorList & chunkFactors) {
+    bool checkpointDue = false;
+    uint64_t checkpointFrontier;
+    FactorList checkpointFactors;
+    {
+        lock_guard<mutex> lock(frontier.frontierMutex);
+        pair<uint64_t, FactorList> & pending = frontier.pendingChunks[start];
+        pending.first = finish;
+        pending.second.swap(chunkFactors);
 
-    bool fullyFactored = false;
-    for (; prime < factoringLimit; prime = it.next_prime()) {
-        while (mpz_divisible_ui_p(n.get_mpz_t(), prime)) {
-            mpz_class tp(prime);
-            foundFactor(factors, tp);
-            mpz_divexact_ui(n.get_mpz_t(), n.get_mpz_t(), prime);
+        map<uint64_t, pair<uint64_t, FactorList> >::iterator it;
+        while ((it = frontier.pendingChunks.find(frontier.frontier)) != frontier.pendingChunks.end()) {
+            frontier.committedFactors.merge(it->second.second); // the chunk's primes are above every committed one
+            frontier.frontier = it->second.first;
+            frontier.pendingChunks.erase(it);
         }
-        if (mpz_cmp_ui(n.get_mpz_t(), 1) == 0) {
-            break;
-        } else if (mpz_probab_prime_p(n.get_mpz_t(), 25)) {
-            foundFactor(factors, n);
+
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        if (now - frontier.lastCheckpoint >= chrono::seconds(frontier.settings->interval)) {
+            frontier.lastCheckpoint = now;
+            checkpointDue = true;
+            checkpointFrontier = frontier.frontier;
+            checkpointFactors = frontier.committedFactors;
+        }
+    }
+    chunkFactors.clear();
+
+    if (checkpointDue) {
+        lock_guard<mutex> lock(frontier.checkpointMutex);
+        if (checkpointFrontier > frontier.checkpointFrontier) {
+            if (saveCheckpoint(frontier.settings->filename, *(frontier.test), frontier.factoringLimit, checkpointFrontier, checkpointFactors)) {
+                frontier.checkpointFrontier = checkpointFrontier;
+            } else {
+                cerr << "WARNING: couldn't write checkpoint file " << frontier.settings->filename << endl;
+            }
+        }
+    }
+}
+
+// Add factors to the running abundance; abundance is index 1 having sigma(d)/d > 2 for its divisor d.
+// The exact check is only needed when the bound on the floating-point sum cannot decide.
+void addAbundance(AbundanceTracker & tracker, FactorList & factors, uint64_t prime) {
+    lock_guard<mutex> lock(tracker.abundanceMutex);
+    tracker.factors.merge(factors);
+    tracker.bound.add(factors);
+    int decision = tracker.bound.decide();
+    if (!tracker.reached && decision >= 0) {
+        if (decision > 0 || exactlyAbundant(tracker.factors)) {
+            tracker.abundantPrime = prime;
+            tracker.reached = true;
+        }
+    }
+}
+
+// Roughly the number of primes below x, x / (log x - 1 - 1 / log x), good to a fraction of a percent above 10^6
+double primeCountEstimate(uint64_t x) {
+    if (x < 100) {
+        return x / 4.0;
+    }
+    double logX = log((double) x);
+    return x / (logX - 1 - 1 / logX);
+}
+
+// Chunk bookkeeping for a worker's progress counters
+inline void beginChunk(ThreadProgress & progress, uint64_t start, uint64_t finish) {
+    progress.chunkStart.store(start, memory_order_relaxed);
+    progress.chunkFinish.store(finish, memory_order_relaxed);
+}
+
+inline void endChunk(ThreadProgress & progress, uint64_t start, uint64_t finish, uint64_t factorCount) {
+    double primeCount = primeCountEstimate(finish) - primeCountEstimate(start);
+    progress.primesTested.store(progress.primesTested.load(memory_order_relaxed) + primeCount, memory_order_relaxed);
+    progress.factorsFound.store(progress.factorsFound.load(memory_order_relaxed) + factorCount, memory_order_relaxed);
+    beginChunk(progress, finish, finish);
+}
+
+// Mark a worker done, recording the CPU time it took since its clock is gone once it is joined
+void finishThread(ThreadProgress & progress, uint64_t factoringLimit) {
+    timespec cpuTime;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuTime) == 0) {
+        progress.cpuNanoseconds.store(cpuTime.tv_sec * 1000000000ULL + cpuTime.tv_nsec, memory_order_relaxed);
+    }
+    beginChunk(progress, factoringLimit, factoringLimit);
+}
+
+// "[<days>d ]HH:MM:SS"
+string formatDuration(double seconds) {
+    uint64_t total = (uint64_t) seconds;
+    char buffer[64];
+    if (total >= 86400) {
+        snprintf(buffer, sizeof(buffer), "%" PRIu64 "d %02u:%02u:%02u", total / 86400, (unsigned) (total / 3600 % 24), (unsigned) (total / 60 % 60), (unsigned) (total % 60));
+    } else {
+        snprintf(buffer, sizeof(buffer), "%02u:%02u:%02u", (unsigned) (total / 3600), (unsigned) (total / 60 % 60), (unsigned) (total % 60));
+    }
+    return buffer;
+}
+
+// What the reporter saw last time, for rates over the interval
+typedef struct {
+    chrono::steady_clock::time_point time;
+    double primesTested;
+    vector<double> cpuSeconds;
+} ProgressSample;
+
+void takeProgressSample(ProgressMonitor & monitor, ProgressSample & sample) {
+    sample.time = chrono::steady_clock::now();
+    sample.primesTested = 0;
+    sample.cpuSeconds.assign(monitor.threadCount, 0);
+    for (uint64_t i = 0; i < monitor.threadCount; i++) {
+        sample.primesTested += monitor.threads[i].primesTested.load(memory_order_relaxed);
+        uint64_t cpuNanoseconds = monitor.threads[i].cpuNanoseconds.load(memory_order_relaxed);
+        timespec cpuTime;
+        if (cpuNanoseconds || i >= monitor.threadClocks.size() || !monitor.threadClockValid[i]) {
+            sample.cpuSeconds[i] = cpuNanoseconds * 1e-9;
+        } else if (clock_gettime(monitor.threadClocks[i], &cpuTime) == 0) {
+            sample.cpuSeconds[i] = cpuTime.tv_sec + cpuTime.tv_nsec * 1e-9;
+        }
+    }
+}
+
+// Print a progress line to standard error, or rewrite the status file as one JSON object
+void reportProgress(ProgressMonitor & monitor, ProgressSample & previous, bool finished) {
+    ProgressSample sample;
+    takeProgressSample(monitor, sample);
+
+    // Every prime below the frontier is done: no thread has a chunk below it, and none is left to claim
+    uint64_t frontier = min(monitor.scheduler->nextStart.load(memory_order_relaxed), monitor.factoringLimit);
+    uint64_t factorsFound = 0;
+    for (uint64_t i = 0; i < monitor.threadCount; i++) {
+        frontier = min(frontier, monitor.threads[i].chunkStart.load(memory_order_relaxed));
+        factorsFound += monitor.threads[i].factorsFound.load(memory_order_relaxed);
+    }
+
+    double elapsed = chrono::duration<double>(sample.time - monitor.startTime).count();
+    double interval = chrono::duration<double>(sample.time - previous.time).count();
+    double rate = interval > 0 ? (sample.primesTested - previous.primesTested) / interval : 0;
+    double averageRate = elapsed > 0 ? sample.primesTested / elapsed : 0;
+    double totalPrimes = primeCountEstimate(monitor.factoringLimit) - primeCountEstimate(monitor.start);
+    double fraction = finished ? 1 : totalPrimes > 0 ? min(sample.primesTested / totalPrimes, 1.0) : 0;
+    double eta = finished ? 0 : averageRate > 0 ? max(totalPrimes - sample.primesTested, 0.0) / averageRate : -1;
+    // Share of the interval each thread spent on a CPU; the final report covers the whole run
+    vector<double> utilization(monitor.threadCount, 0);
+    for (uint64_t i = 0; i < monitor.threadCount; i++) {
+        double cpuSeconds = finished ? sample.cpuSeconds[i] : sample.cpuSeconds[i] - previous.cpuSeconds[i];
+        double seconds = finished ? elapsed : interval;
+        if (seconds > 0 && cpuSeconds >= 0) {
+            utilization[i] = min(cpuSeconds / seconds, 1.0);
+        }
+    }
+
+    if (monitor.settings->statusFilename.empty()) {
+        fprintf(stderr, "[%s] frontier=%" PRIu64 " (%.1f%%) primes=%.0f factors=%" PRIu64 " rate=%.0f/s threads=",
+                formatDuration(elapsed).c_str(), frontier, 100 * fraction, sample.primesTested, factorsFound, rate);
+        for (uint64_t i = 0; i < monitor.threadCount; i++) {
+            fprintf(stderr, i ? ",%.0f%%" : "%.0f%%", 100 * utilization[i]);
+        }
+        fprintf(stderr, " eta=%s\n", eta < 0 ? "unknown" : formatDuration(eta).c_str());
+    } else {
+        string tmpFilename = monitor.settings->statusFilename + ".tmp";
+        FILE *file = fopen(tmpFilename.c_str(), "w");
+        if (file != NULL) {
+            fprintf(file, "{\"elapsed\": %.1f, \"frontier\": %" PRIu64 ", \"limit\": %" PRIu64 ", \"fraction\": %.6f, \"primesTested\": %.0f"
+                    ", \"factorsFound\": %" PRIu64 ", \"primesPerSec\": %.1f, \"averagePrimesPerSec\": %.1f, \"utilization\": [",
+                    elapsed, frontier, monitor.factoringLimit, fraction, sample.primesTested, factorsFound, rate, averageRate);
+            for (uint64_t i = 0; i < monitor.threadCount; i++) {
+                fprintf(file, i ? ", %.3f" : "%.3f", utilization[i]);
+            }
+            if (eta < 0) {
+                fprintf(file, "], \"eta\": null, \"finished\": %s}\n", finished ? "true" : "false");
+            } else {
+                fprintf(file, "], \"eta\": %.1f, \"finished\": %s}\n", eta, finished ? "true" : "false");
+            }
+        }
+        if (file == NULL || fclose(file) != 0 || rename(tmpFilename.c_str(), monitor.settings->statusFilename.c_str()) != 0) {
+            cerr << "WARNING: couldn't write status file " << monitor.settings->statusFilename << endl;
+        }
+    }
+    previous.time = sample.time;
+    previous.primesTested = sample.primesTested;
+    previous.cpuSeconds.swap(sample.cpuSeconds);
+}
+
+static void progressReporter(ProgressMonitor *monitor) {
+    // Held except while waiting. A worker's clock is marked invalid under this lock before the worker is
+    // joined, so no clock is read once its thread is gone.
+    unique_lock<mutex> lock(monitor->stopMutex);
+    ProgressSample previous;
+    takeProgressSample(*monitor, previous);
+    previous.time = monitor->startTime;
+    while (!monitor->stopSignal.wait_for(lock, chrono::seconds(monitor->settings->interval), [monitor] { return monitor->stopping; })) {
+        reportProgress(*monitor, previous, false);
+    }
+    reportProgress(*monitor, previous, true);
+}
+
+void initProgressMonitor(ProgressMonitor & monitor, ProgressSettings *settings, ChunkScheduler & scheduler, uint64_t start, uint64_t factoringLimit, uint64_t threadCount) {
+    monitor.settings = settings;
+    monitor.scheduler = &scheduler;
+    monitor.threads.reset(new ThreadProgress[threadCount]);
+    for (uint64_t i = 0; i < threadCount; i++) {
+        beginChunk(monitor.threads[i], start, start);
+    }
+    monitor.threadCount = threadCount;
+    monitor.start = start;
+    monitor.factoringLimit = factoringLimit;
+    monitor.startTime = chrono::steady_clock::now();
+    monitor.stopping = false;
+}
+
+// Start reporting once the workers are running, so their CPU clocks can be read
+thread startProgressReporter(ProgressMonitor & monitor, vector<thread> & workers) {
+    for (vector<thread>::size_type i = 0; i < workers.size(); i++) {
+        clockid_t clock;
+        if (pthread_getcpuclockid(workers[i].native_handle(), &clock) != 0) {
+            monitor.threadClocks.clear();
             break;
         }
+        monitor.threadClocks.push_back(clock);
+    }
+    monitor.threadClockValid.assign(monitor.threadClocks.size(), true);
+    return thread(progressReporter, &monitor);
+}
+
+// Join the workers. With a reporter running, each worker's clock is marked invalid first, under the lock
+// the reporter holds while reading the clocks; from then on only its recorded CPU time is used.
+void joinWorkers(vector<thread> & workers, ProgressMonitor *monitor) {
+    for (vector<thread>::size_type i = 0; i < workers.size(); i++) {
+        if (monitor) {
+            lock_guard<mutex> lock(monitor->stopMutex);
+            if (i < monitor->threadClockValid.size()) {
+                monitor->threadClockValid[i] = false;
+            }
+        }
+        workers[i].join();
+    }
+}
+
+// Stop the reporter after a final report; the workers must have been joined with joinWorkers
+void stopProgressReporter(ProgressMonitor & monitor, thread & reporter) {
+    {
+        lock_guard<mutex> lock(monitor.stopMutex);
+        monitor.stopping = true;
+    }
+    monitor.stopSignal.notify_one();
+    reporter.join();
+}
+
+// Test prime exactly, assuming the first (firstPower - 1) powers divide, and record it if it divides index 1.
+// False once the search should stop.
+static inline bool testPrime(FullFactorData *data, IndexOneWorkspace & workspace, FactorList & resultFactors, uint64_t prime, int firstPower = 1) {
+    int divideAmount = primeMultiplicity(*(data->test), workspace, prime, firstPower);
+
+    if (divideAmount > 0) {
+        resultFactors.add(prime, divideAmount);
+        if (data->abundance) {
+            FactorList hit;
+            hit.add(prime, divideAmount);
+            addAbundance(*(data->abundance), hit, prime);
+        }
+    }
+    return !(data->abundance && data->abundance->reached.load(memory_order_relaxed));
+}
+
+// Screen a block of primes below 2^32 and test exactly only those that pass. For a prime not dividing the
+// divisor, the screen is the exact test of the prime itself, so only its higher powers are left to try.
+// False once the search should stop, with the prime reached in stopPrime.
+static bool testBlock(FullFactorData *data, IndexOneWorkspace & workspace, FactorList & resultFactors, const uint32_t *block, int count, uint64_t & stopPrime) {
+    uint32_t passed = data->test->screenKernel(data->test->screen, block, count);
+    for (; passed; passed &= passed - 1) {
+        stopPrime = block[__builtin_ctz(passed)];
+        if (!testPrime(data, workspace, resultFactors, stopPrime, divisorCoprime(*(data->test), stopPrime) ? 2 : 1)) {
+            return false;
+        }
+    }
+    stopPrime = block[count - 1];
+    return !(data->abundance && data->abundance->reached.load(memory_order_relaxed));
+}
+
+static void entryPoint(FullFactorData *data, uint64_t threadNum) {
+    // With checkpoints, factors are handed over chunk by chunk so the frontier knows what is complete
+    FactorList chunkFactors;
+    FactorList & resultFactors = data->frontier ? chunkFactors : data->threadFactors[threadNum];
+    IndexOneWorkspace workspace(data->test->divisor);
+    ThreadProgress *progress = data->progress ? &data->progress->threads[threadNum] : NULL;
+
+    uint64_t start, finish;
+    while (nextChunk(*(data->scheduler), start, finish)) {
+        if (progress) {
+            beginChunk(*progress, start, finish);
+        }
+        size_t factorsBefore = resultFactors.size();
+        primesieve::iterator it(start, finish);
+        uint64_t prime = it.next_prime();
+        // Odd primes below 2^32 wait in block for the screen, when there is one
+        uint64_t screenFinish = data->test->screenKernel ? min(finish, (uint64_t) 1 << 32) : 0;
+        uint32_t block[POWER_FILTER_BLOCK];
+        int blockSize = 0;
+        bool stopped = false;
+        for (; prime < finish; prime = it.next_prime()) {
+            if (data->test->sieveCandidates && !mayDivideIndexOne(*(data->test), prime)) {
+                continue;
+            }
+            if (prime < screenFinish && prime > 2) {
+                block[blockSize++] = (uint32_t) prime;
+                if (blockSize == POWER_FILTER_BLOCK) {
+                    blockSize = 0;
+                    if (!testBlock(data, workspace, resultFactors, block, POWER_FILTER_BLOCK, prime)) {
+                        stopped = true;
+                        break;
+                    }
+                }
+                continue;
+            }
+            // Flush the screened primes first, so a chunk crossing 2^32 still finds its factors in order
+            if (blockSize > 0) {
+                uint64_t next = prime;
+                int count = blockSize;
+                blockSize = 0;
+                if (!testBlock(data, workspace, resultFactors, block, count, prime)) {
+                    stopped = true;
+                    break;
+                }
+                prime = next;
+            }
+            if (!testPrime(data, workspace, resultFactors, prime)) {
+                stopped = true;
+                break;
+            }
+        }
+        if (!stopped && blockSize > 0) {
+            stopped = !testBlock(data, workspace, resultFactors, block, blockSize, prime);
+        }
+        if (stopped) {
+            if (progress) {
+                endChunk(*progress, start, prime, resultFactors.size() - factorsBefore);
+                finishThread(*progress, data->scheduler->factoringLimit);
+            }
+            return; // an unfinished chunk never reaches the frontier
+        }
+
+        if (progress) {
+            endChunk(*progress, start, finish, resultFactors.size() - factorsBefore);
+        }
+        if (data->frontier) {
+            completeChunk(*(data->frontier), start, finish, chunkFactors);
+        }
+    }
+    if (progress) {
+        finishThread(*progress, data->scheduler->factoringLimit);
+    }
+}
+
+// Gather the per-thread result lists into one. A thread claims chunks in ascending order, so its list is
+// already sorted and each merge is a single pass.
+void collectFactors(vector<FactorList> & threadFactors, FactorList & resultFactors) {
+    for (vector<FactorList>::size_type i = 0; i < threadFactors.size(); i++) {
+        threadFactors[i].merge();
+        resultFactors.merge(threadFactors[i]);
+    }
+}
+
+// Perform simple trial factoring of the primes in [start, factoringLimit). On entry, resultFactors
+// holds the factors already known for the primes below start, and these are kept.
+// With stopWhenAbundant, the search ends as soon as the factors found prove index 1 abundant; the prime
+// that did so is returned in abundantPrime (0 if the whole range was searched).
+uint64_t fullFactor(mpz_class base, FactorList & baseFactors, mpz_class exponent, uint64_t factoringLimit, FactorList & resultFactors, uint64_t threadCount = 1, CheckpointSettings *checkpoint = NULL, uint64_t start = 0, bool stopWhenAbundant = false, uint64_t *abundantPrime = NULL, ProgressSettings *progressSettings = NULL, const FactorList *exponentFactors = NULL) {
+    IndexOneTest test;
+    initIndexOneTest(test, base, baseFactors, exponent);
+    initCandidateSieve(test, factoringLimit, exponentFactors);
+    resultFactors.merge();
+
+    ChunkFrontier frontier;
+    if (checkpoint) {
+        frontier.frontier = start;
+        frontier.committedFactors = resultFactors;
+        frontier.settings = checkpoint;
+        frontier.test = &test;
+        frontier.factoringLimit = factoringLimit;
+        frontier.lastCheckpoint = chrono::steady_clock::now();
+        if (checkpoint->resume) {
+            mpz_class checkpointBase, checkpointExponent;
+            uint64_t checkpointLimit = 0;
+            if (!loadCheckpoint(checkpoint->filename, checkpointBase, checkpointExponent, checkpointLimit, frontier.frontier, frontier.committedFactors)) {
+                cerr << "ERROR: couldn't read checkpoint file " << checkpoint->filename << endl;
+                exit(2);
+            }
+            if (checkpointBase != base || checkpointExponent != exponent || checkpointLimit != factoringLimit) {
+                cerr << "ERROR: checkpoint is for " << checkpointBase << "^" << checkpointExponent << " up to limit=" << checkpointLimit << endl;
+                exit(2);
+            }
+            start = frontier.frontier;
+        }
+        frontier.checkpointFrontier = frontier.frontier;
+    }
+
+    AbundanceTracker abundance;
+    if (stopWhenAbundant) {
+        abundance.reached = false;
+        abundance.abundantPrime = 0;
+        // Earlier results may already be enough; the largest of them is then the one credited
+        FactorList & knownFactors = checkpoint ? frontier.committedFactors : resultFactors;
+        knownFactors.merge();
+        addAbundance(abundance, knownFactors, knownFactors.empty() ? 0 : mpz_get_ui(knownFactors.prime(knownFactors.size() - 1).get_mpz_t()));
+    }
+
+    ChunkScheduler scheduler;
+    initChunkScheduler(scheduler, start, factoringLimit, threadCount);
+
+    ProgressMonitor progress;
+    if (progressSettings) {
+        initProgressMonitor(progress, progressSettings, scheduler, start, factoringLimit, threadCount);
+    }
+
+    FullFactorData data;
+    data.test = &test;
+    data.scheduler = &scheduler;
+    data.frontier = checkpoint ? &frontier : NULL;
+    data.abundance = stopWhenAbundant ? &abundance : NULL;
+    data.progress = progressSettings ? &progress : NULL;
+    data.threadFactors.resize(threadCount);
+
+    vector<thread> threads;
+    for (uint64_t threadNum = 0; threadNum < threadCount; threadNum++) {
+        threads.push_back(thread(entryPoint, &data, threadNum));
+    }
+    thread reporter;
+    if (progressSettings) {
+        reporter = startProgressReporter(progress, threads);
+    }
+    joinWorkers(threads, progressSettings ? &progress : NULL);
+    if (progressSettings) {
+        stopProgressReporter(progress, reporter);
     }
 
-    merge_factors(factors); //sorts factors and merges any <p,x>,<p,y> into <p,x+y>
+    if (checkpoint) {
+        resultFactors.swap(frontier.committedFactors);
+        if (!saveCheckpoint(checkpoint->filename, test, factoringLimit, frontier.frontier, resultFactors)) {
+            cerr << "WARNING: couldn't write checkpoint file " << checkpoint->filename << endl;
+        }
+    } else {
+        collectFactors(data.threadFactors, resultFactors);
+    }
+
+    if (abundantPrime) {
+        *abundantPrime = 0;
+    }
+    if (stopWhenAbundant && abundance.reached) {
+        // The tracker also has the factors of unfinished chunks
+        resultFactors.swap(abundance.factors);
+        if (abundantPrime) {
+            *abundantPrime = abundance.abundantPrime;
+        }
+    }
+
+    uint64_t totalFactorCount = 0;
+    for (size_t i = 0; i < resultFactors.size(); i++) {
+        totalFactorCount += resultFactors.multiplicity(i);
+    }
+    return totalFactorCount;
+}
+
+// Keep only the factors whose primes are below limit
+void dropFactorsFrom(FactorList & factors, uint64_t limit) {
+    FactorList kept;
+    for (size_t i = 0; i < factors.size() && factors.isWord(i); i++) {
+        if (factors.word(i) < limit) {
+            kept.add(factors, i);
+        }
+    }
+    factors.swap(kept);
+}
+
+// Read the factors and limit of an earlier run, from its checkpoint file or its saved output
+bool loadPreviousResults(string filename, mpz_class & base, mpz_class & exponent, uint64_t & previousLimit, FactorList & factors) {
+    uint64_t checkpointLimit;
+    if (loadCheckpoint(filename, base, exponent, checkpointLimit, previousLimit, factors)) {
+        return true; // an unfinished run is extended from its frontier
+    }
+
+    ifstream file(filename);
+    if (!file.is_open()) {
+        return false;
+    }
+    const string factorPrefix = "d = ";
+    const string limitMarker = " * remainder up to limit=";
+    const string noFactorsPrefix = "No factors found up to limit=";
+    const string indexPrefix = "Index 1 of ";
+    bool haveLimit = false;
+    string line;
+    while (getline(file, line)) {
+        string::size_type marker = line.find(limitMarker);
+        if (line.compare(0, factorPrefix.size(), factorPrefix) == 0 && marker != string::npos) {
+            parseFactors(factors, line.substr(factorPrefix.size(), marker - factorPrefix.size()));
+            previousLimit = stoull(line.substr(marker + limitMarker.size()));
+            haveLimit = true;
+        } else if (line.compare(0, noFactorsPrefix.size(), noFactorsPrefix) == 0) {
+            factors.clear();
+            previousLimit = stoull(line.substr(noFactorsPrefix.size()));
+            haveLimit = true;
+        } else if (line.compare(0, indexPrefix.size(), indexPrefix) == 0) {
+            string power = line.substr(indexPrefix.size());
+            power = power.substr(0, power.find(' '));
+            string::size_type caret = power.find('^');
+            if (caret != string::npos) {
+                base.set_str(power.substr(0, caret), 10);
+                exponent.set_str(power.substr(caret + 1), 10);
+            }
+        }
+    }
+    // Older runs scanned whole chunks past their limit, and the primes found there would be found again
+    dropFactorsFrom(factors, previousLimit);
+    return haveLimit;
 }
 
 typedef struct {
     mpz_class *base;
-    vector<Factor> *baseFactors;
+    FactorList *baseFactors;
     mpz_class *divisor;
-    mpz_class *exponent;
-    mpz_class *exponentPlusOne;
-    uint64_t factoringLimit;
-    vector<Factor> *resultFactors;
-    uint64_t nextThousand;
-    uint64_t totalFactorCount;
-    pthread_mutex_t resultFactorsMutex;
-    pthread_mutex_t nextThousandMutex;
-} FullFactorData;
+    vector<mpz_class> *exponents;
+    vector<mpz_class> *exponentSteps;
+    vector<IndexOneTest> *tests;
+    ChunkScheduler *scheduler;
+    ProgressMonitor *progress; // only when reporting progress
+    vector<vector<FactorList> > threadFactors; // [thread][exponent], merged at the end
+} BatchFactorData;
 
-static void *entryPoint(void *threadInfo) {
-    FullFactorData *data;
-    data = (FullFactorData *) threadInfo;
+static void batchEntryPoint(BatchFactorData *data, uint64_t threadNum) {
+    vector<FactorList> & resultFactors = data->threadFactors[threadNum];
+    FactorList & baseFactors = *(data->baseFactors);
+    vector<mpz_class> & basePrimes = (*data->tests)[0].basePrimes;
+    vector<mpz_class> & exponents = *(data->exponents);
+    vector<mpz_class> & exponentSteps = *(data->exponentSteps);
+    mpz_class firstExponentPlusOne = exponents[0] + 1;
 
-    mpz_class tmp;
+    // Residues of each base factor to the (exponent + 1)th power and of the base to the exponent, carried from one exponent to the next
+    vector<mpz_class> factorPowers(baseFactors.size());
+    vector<mpz_class> factorSteps(baseFactors.size());
+    mpz_class basePower, baseStep;
+    mpz_class modulus, firstAddend, tmp;
+    IndexOneWorkspace workspace(*(data->divisor));
+    ThreadProgress *progress = data->progress ? &data->progress->threads[threadNum] : NULL;
 
-    while (true) {
-        if (pthread_mutex_lock(&(data->nextThousandMutex)) != 0) {
-            cerr << "Unable to lock loop mutex. Exiting." << endl;
-            exit(2);
-        }
-        uint64_t nextThousand = data->nextThousand;
-        uint64_t start = nextThousand * 1000;
-        uint64_t finish = (nextThousand + 1) * 1000;
-        if (start >= data->factoringLimit) {
-            pthread_mutex_unlock(&(data->nextThousandMutex));
-            pthread_exit(0);
+    uint64_t start, finish;
+    while (nextChunk(*(data->scheduler), start, finish)) {
+        if (progress) {
+            beginChunk(*progress, start, finish);
         }
-        data->nextThousand++;
-        pthread_mutex_unlock(&(data->nextThousandMutex));
-
+        uint64_t factorCount = 0;
         primesieve::iterator it(start, finish);
         uint64_t prime = it.next_prime();
         for (; prime < finish; prime = it.next_prime()) {
-            mpz_class candidate(prime);
-            bool doesDivideThisPrime;
-            int divideAmount = -1;
-            do {
-                mpz_class firstAddend = 1;
-                mpz_class modulus = *(data->divisor) * candidate;
-                for (vector<Factor>::size_type i = 0; i < data->baseFactors->size(); i++) {
-                    mpz_class div = (*data->baseFactors)[i].first;
-                    for (uint64_t j = 0; j < (*data->baseFactors)[i].second; j++) {
-                        mpz_powm(tmp.get_mpz_t(), div.get_mpz_t(), data->exponentPlusOne->get_mpz_t(), modulus.get_mpz_t());
-                        if (mpz_cmp_ui(tmp.get_mpz_t(), 0) == 0) { // we want to avoid negative numbers
-                            tmp = modulus - 1;
-                        } else if (mpz_cmp_ui(tmp.get_mpz_t(), 1) == 0) { // special case: in this case, we can break out early, since the product will be 0 if a single factor is 0
-                            firstAddend = 0;
-                            break;
-                        } else {
-                            tmp--;
+            // One modulus per prime, shared by every exponent: the prime alone unless it divides the divisor
+            if (mpz_fdiv_ui(data->divisor->get_mpz_t(), prime) != 0) {
+                modulus = prime;
+            } else {
+                modulus = *(data->divisor) * prime;
+            }
+            for (size_t i = 0; i < baseFactors.size(); i++) {
+                mpz_powm(factorPowers[i].get_mpz_t(), basePrimes[i].get_mpz_t(), firstExponentPlusOne.get_mpz_t(), modulus.get_mpz_t());
+            }
+            mpz_powm(basePower.get_mpz_t(), data->base->get_mpz_t(), exponents[0].get_mpz_t(), modulus.get_mpz_t());
+
+            for (vector<mpz_class>::size_type k = 0; k < exponents.size(); k++) {
+                if (k > 0) {
+                    // Step the residues forward instead of exponentiating from scratch; a range has a single step, so this is one powm per prime
+                    if (k == 1 || exponentSteps[k] != exponentSteps[k - 1]) {
+                        for (size_t i = 0; i < baseFactors.size(); i++) {
+                            mpz_powm(factorSteps[i].get_mpz_t(), basePrimes[i].get_mpz_t(), exponentSteps[k].get_mpz_t(), modulus.get_mpz_t());
                         }
-                        firstAddend *= tmp;
-                        // for bases with tons of factors, we could do
-                        //     firstAddend %= modulus;
-                        // here, at least sometimes
+                        mpz_powm(baseStep.get_mpz_t(), data->base->get_mpz_t(), exponentSteps[k].get_mpz_t(), modulus.get_mpz_t());
+                    }
+                    for (size_t i = 0; i < baseFactors.size(); i++) {
+                        factorPowers[i] *= factorSteps[i];
+                        factorPowers[i] %= modulus;
                     }
+                    basePower *= baseStep;
+                    basePower %= modulus;
                 }
-                mpz_powm(tmp.get_mpz_t(), data->base->get_mpz_t(), data->exponent->get_mpz_t(), modulus.get_mpz_t());
-                mpz_class secondAddend = modulus - tmp * *(data->divisor);
-                mpz_class sum = firstAddend + secondAddend;
-                sum %= modulus;
-                doesDivideThisPrime = mpz_cmp_ui(sum.get_mpz_t(), 0) == 0;
-                divideAmount++; // this will also be increased if the division is unsuccessful, that's why we start with -1
-                candidate *= prime;
-            } while (doesDivideThisPrime); // the number could divide n and n² and n³...
-
-            if (divideAmount > 0) {
-                if (pthread_mutex_lock(&(data->resultFactorsMutex)) != 0) {
-                    cerr << "Unable to lock vector mutex. Exiting." << endl;
-                    exit(2);
+
+                firstAddend = 1;
+                for (size_t i = 0; i < baseFactors.size(); i++) {
+                    tmp = factorPowers[i] - 1;
+                    if (tmp < 0) {
+                        tmp += modulus;
+                    }
+                    if (baseFactors.multiplicity(i) > 1) {
+                        mpz_powm_ui(tmp.get_mpz_t(), tmp.get_mpz_t(), baseFactors.multiplicity(i), modulus.get_mpz_t());
+                    }
+                    firstAddend *= tmp;
+                    firstAddend %= modulus;
                 }
-                foundFactor(*(data->resultFactors), mpz_class(prime), divideAmount);
-                data->totalFactorCount += divideAmount;
-                pthread_mutex_unlock(&(data->resultFactorsMutex));
+                mpz_mul(tmp.get_mpz_t(), basePower.get_mpz_t(), data->divisor->get_mpz_t());
+                mpz_sub(tmp.get_mpz_t(), firstAddend.get_mpz_t(), tmp.get_mpz_t());
+                if (!mpz_divisible_p(tmp.get_mpz_t(), modulus.get_mpz_t())) {
+                    continue;
+                }
+
+                // Hits are rare, so find the multiplicity with the single-exponent test
+                int divideAmount = primeMultiplicity((*data->tests)[k], workspace, prime, 2);
+                resultFactors[k].add(prime, divideAmount);
+                factorCount++;
             }
         }
+        if (progress) {
+            endChunk(*progress, start, finish, factorCount);
+        }
+    }
+    if (progress) {
+        finishThread(*progress, data->scheduler->factoringLimit);
     }
 }
 
-// Perform simple trial factoring
-uint64_t fullFactor(mpz_class base, vector<Factor> baseFactors, mpz_class exponent, uint64_t factoringLimit, vector<Factor> & resultFactors, uint64_t threadCount = 1) {
+// Perform trial factoring of many exponents in a single pass over the primes
+void batchFactor(mpz_class base, FactorList & baseFactors, vector<mpz_class> & exponents, uint64_t factoringLimit, vector<FactorList> & resultFactors, uint64_t threadCount = 1, ProgressSettings *progressSettings = NULL) {
+    sort(exponents.begin(), exponents.end());
+    exponents.erase(unique(exponents.begin(), exponents.end()), exponents.end());
+
     resultFactors.clear();
+    resultFactors.resize(exponents.size());
+    if (exponents.empty()) {
+        return;
+    }
 
-    mpz_class divisor = 1;
+    vector<mpz_class> exponentSteps(exponents.size());
+    exponentSteps[0] = exponents[0];
+    for (vector<mpz_class>::size_type k = 1; k < exponents.size(); k++) {
+        exponentSteps[k] = exponents[k] - exponents[k - 1];
+    }
 
-    for (vector<Factor>::size_type i = 0; i < baseFactors.size(); i++) {
-        mpz_class factorMinusOne = baseFactors[i].first - 1;
-        for (uint64_t j = 0; j < baseFactors[i].second; j++) {
-            divisor *= factorMinusOne;
-        }
+    mpz_class divisor = computeDivisor(baseFactors);
+
+    vector<IndexOneTest> tests(exponents.size());
+    for (vector<mpz_class>::size_type k = 0; k < exponents.size(); k++) {
+        initIndexOneTest(tests[k], base, baseFactors, exponents[k]);
     }
 
-    FullFactorData data;
+    ChunkScheduler scheduler;
+    initChunkScheduler(scheduler, 0, factoringLimit, threadCount);
+
+    BatchFactorData data;
     data.base = &base;
     data.baseFactors = &baseFactors;
     data.divisor = &divisor;
-    data.exponent = &exponent;
-    mpz_class exponentPlusOne = exponent + 1;
-    data.exponentPlusOne = &exponentPlusOne;
-    data.factoringLimit = factoringLimit;
-    data.resultFactors = &resultFactors;
-    data.nextThousand = 0;
-    data.totalFactorCount = 0;
+    data.exponents = &exponents;
+    data.exponentSteps = &exponentSteps;
+    data.tests = &tests;
+    data.scheduler = &scheduler;
+    data.threadFactors.assign(threadCount, vector<FactorList>(exponents.size()));
 
-    pthread_mutex_init(&(data.resultFactorsMutex), NULL);
-    pthread_mutex_init(&(data.nextThousandMutex), NULL);
+    ProgressMonitor progress;
+    if (progressSettings) {
+        initProgressMonitor(progress, progressSettings, scheduler, 0, factoringLimit, threadCount);
+    }
+    data.progress = progressSettings ? &progress : NULL;
 
-    pthread_t *threads = (pthread_t *)malloc(threadCount * sizeof(pthread_t));
-    uint64_t threadNum;
-    for (threadNum = 0; threadNum < threadCount; threadNum++) {
-        pthread_create(&(threads[threadNum]), NULL, &entryPoint, &data);
+    vector<thread> threads;
+    for (uint64_t threadNum = 0; threadNum < threadCount; threadNum++) {
+        threads.push_back(thread(batchEntryPoint, &data, threadNum));
     }
-    for (threadNum = 0; threadNum < threadCount; threadNum++) {
-        pthread_join(threads[threadNum], NULL);
+    thread reporter;
+    if (progressSettings) {
+        reporter = startProgressReporter(progress, threads);
+    }
+    joinWorkers(threads, progressSettings ? &progress : NULL);
+    if (progressSettings) {
+        stopProgressReporter(progress, reporter);
     }
 
-    merge_factors(resultFactors);
-
-    pthread_mutex_destroy(&(data.resultFactorsMutex));
-    pthread_mutex_destroy(&(data.nextThousandMutex));
+    vector<FactorList> exponentFactors(threadCount);
+    for (vector<mpz_class>::size_type k = 0; k < exponents.size(); k++) {
+        for (uint64_t threadNum = 0; threadNum < threadCount; threadNum++) {
+            exponentFactors[threadNum].swap(data.threadFactors[threadNum][k]);
+        }
+        collectFactors(exponentFactors, resultFactors[k]);
+    }
+}
 
-    return data.totalFactorCount;
+// Parse an exponent range of the form <min>:<max>[:<step>]
+bool parseRange(vector<mpz_class> & exponents, string rangeString) {
+    vector<mpz_class> bounds;
+    string s;
+    stringstream ss(rangeString);
+    while (getline(ss, s, ':')) {
+        if (s.empty() || !isnumber(s)) {
+            return false;
+        }
+        bounds.push_back(mpz_class(s));
+    }
+    if (bounds.size() < 2 || bounds.size() > 3) {
+        return false;
+    }
+    mpz_class step = bounds.size() == 3 ? bounds[2] : mpz_class(1);
+    if (step == 0) {
+        return false;
+    }
+    for (mpz_class exponent = bounds[0]; exponent <= bounds[1]; exponent += step) {
+        exponents.push_back(exponent);
+    }
+    return true;
 }
 
-// Multiply out the factor vector
-void multiply(vector<Factor> & factors, mpz_class & n) {
-    mpz_class tmp;
-    n = 1;
-    for (vector<Factor>::size_type j = 0; j < factors.size(); ++j) {
-        mpz_pow_ui(tmp.get_mpz_t(), factors[j].first.get_mpz_t(), factors[j].second);
-        n *= tmp;
+// The number of primes in [start, finish)
+uint64_t countPrimes(uint64_t start, uint64_t finish) {
+    primesieve::iterator it(start, finish);
+    uint64_t count = 0;
+    for (uint64_t prime = it.next_prime(); prime < finish; prime = it.next_prime()) {
+        count++;
     }
+    return count;
 }
 
-// Calculate the sum of divisors and product of the factor vector
-void sigma(vector<Factor> & factors, mpz_class & s, mpz_class & n) {
-    mpz_class t, tmp, tmp2;
-    n = 1;
-    s = 1;
-    for (vector<Factor>::size_type j = 0; j < factors.size(); ++j) {
-        if (factors[j].second == 1) {
-            t = factors[j].first + 1;
-        } else {
-            t = 1;
-            mpz_pow_ui(tmp.get_mpz_t(), factors[j].first.get_mpz_t(), factors[j].second + 1);
-            tmp -= 1;
-            tmp2 = factors[j].first - 1;
-            mpz_divexact(t.get_mpz_t(), tmp.get_mpz_t(), tmp2.get_mpz_t());
+// Time the kernels on fixed inputs, one thread each, for --bench
+void runBenchmarks() {
+    Benchmark bench("powerTrialFactoring");
+
+    // Single exponents through fullFactor and entryPoint: word base, composite base, multi-limb exponent,
+    // a base too large for the Montgomery path, and primes far above the usual limits
+    struct {
+        const char *name;
+        const char *base;
+        const char *exponent;
+        uint64_t start;
+        uint64_t limit;
+    } cases[] = {
+        { "smallPrimeBase", "3",  "1009", 0, 10000000 },
+        { "compositeBase",  "30", "1009", 0, 10000000 },
+        { "baseTwo",        "2",  "720720", 0, 10000000 },
+        { "largeExponent",  "3",  "170141183460469231731687303715884105727", 0, 10000000 },
+        { "largeBase",      "340282366920938463463374607431768211507", "12", 0, 1000000 },
+        { "deepLimit",      "3",  "1009", 1000000000000ULL, 1000001000000ULL }
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        mpz_class base(cases[i].base), exponent(cases[i].exponent);
+        FactorList baseFactors;
+        simpleFactor(base, baseFactors, FactoringBounds());
+        uint64_t start = cases[i].start, limit = cases[i].limit;
+        bench.run("entryPoint", cases[i].name, countPrimes(start, limit), [&] {
+            FactorList resultFactors;
+            fullFactor(base, baseFactors, exponent, limit, resultFactors, 1, NULL, start);
+        });
+    }
+
+    // The composite base again under each screening kernel this CPU runs, and with no screen at all
+    {
+        const PowerFilterKernel *defaultFilters = powerFilters;
+        mpz_class base = 30, exponent = 1009;
+        FactorList baseFactors;
+        simpleFactor(base, baseFactors, FactoringBounds());
+        const char *kernels[] = { "avx512", "avx2", "scalar", "none" };
+        for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+            powerFilters = powerFilterKernels(kernels[i]);
+            if (!powerFilters && string(kernels[i]) != "none") {
+                continue;
+            }
+            bench.run("powerFilter", kernels[i], countPrimes(0, 10000000), [&] {
+                FactorList resultFactors;
+                fullFactor(base, baseFactors, exponent, 10000000, resultFactors);
+            });
         }
+        powerFilters = defaultFilters;
+    }
 
-        s *= t;
+    // 64 exponents in one pass over the primes; a candidate is one prime tried for one exponent
+    {
+        mpz_class base = 3;
+        FactorList baseFactors;
+        simpleFactor(base, baseFactors, FactoringBounds());
+        vector<mpz_class> exponents;
+        parseRange(exponents, "1001:1127:2");
+        bench.run("batchEntryPoint", "smallPrimeBase", countPrimes(0, 1000000) * exponents.size(), [&] {
+            vector<FactorList> resultFactors;
+            batchFactor(base, baseFactors, exponents, 1000000, resultFactors);
+        });
+    }
 
-        mpz_pow_ui(tmp.get_mpz_t(), factors[j].first.get_mpz_t(), factors[j].second);
-        n *= tmp;
+    // Base factoring, a candidate being one number: trial division alone, a semiprime that rho splits, and
+    // 2^128 + 1 = 59649589127497217 * 5704689200685129054721, whose factors are out of reach of the default
+    // bounds so that every stage runs in full
+    struct {
+        const char *name;
+        mpz_class n;
+        uint64_t repetitions;
+    } numbers[] = {
+        { "smoothBase",    mpz_class("70505500196959027200000"), 1000 },
+        { "semiprimeBase", mpz_class(1000000007) * 998244353, 20 },
+        { "fermat7",       (mpz_class(1) << 128) + 1, 1 }
+    };
+    for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+        const mpz_class & n = numbers[i].n;
+        uint64_t repetitions = numbers[i].repetitions;
+        bench.run("factorCompletely", numbers[i].name, repetitions, [&] {
+            FactorList factors;
+            mpz_class cofactor;
+            for (uint64_t j = 0; j < repetitions; j++) {
+                factorCompletely(n, FactoringBounds(), factors, cofactor);
+            }
+        });
     }
 }
 
 // Print help
 void print_help() {
     cout << "usage: powerTrialFactoring <base> [<exponent> | -x <exponentFile>] [-l <limit>] [-t <threadCount>]" << endl
-         << "<limit> defaults to 100k; <threadCount> defaults to 1." << endl;
+         << "       powerTrialFactoring <base> [-b] [<exponent>... | -x <exponentFile> | -r <min>:<max>[:<step>]] [-l <limit>] [-t <threadCount>]" << endl
+         << "<limit> defaults to 100k; <threadCount> defaults to 1." << endl
+         << "-b (or -r) tests every exponent given (one per line in <exponentFile>) in a single pass over the primes." << endl
+         << "-c <checkpointFile> saves progress every -i <seconds> (default 300); --resume continues from it." << endl
+         << "-e <previousFile> extends an earlier run (its output or checkpoint) from its limit up to <limit>." << endl
+         << "-a stops as soon as the factors found prove index 1 abundant." << endl
+         << "-f <cacheFile> reuses and records results in a factor cache shared with the other tools." << endl
+         << "-o <outputFile> appends the result lines to <outputFile> (batch lines go to standard output by default);" << endl
+         << "   -j writes them as JSON lines, and -s <seconds> syncs the file that often (default only on exit)." << endl
+         << "-p <seconds> reports the frontier, rate, thread utilization and ETA on standard error that often;" << endl
+         << "   --status <statusFile> rewrites <statusFile> with them as JSON instead (every 60 seconds by default)." << endl
+         << "The base is factored completely by trial division below 10^6, Pollard rho and P-1; --rho <iterations>" << endl
+         << "   (default 2^20) and --pm1 <B1> (default 10^6) bound the last two." << endl
+         << "--filter <kernel> screens the primes below 2^32 with avx512, avx2 or scalar code, or none at all" << endl
+         << "   (default the widest this CPU runs)." << endl
+         << "--bench times the factoring kernels on fixed inputs and prints one JSON line per case." << endl;
 }
 
 #define DEFAULT_TF_LIMIT 100000
+#define DEFAULT_CHECKPOINT_INTERVAL 300
+#define DEFAULT_PROGRESS_INTERVAL 60
+
+// Codes for long-only options
+enum { OPT_RESUME = 256, OPT_BENCH, OPT_STATUS, OPT_RHO, OPT_PM1, OPT_FILTER };
 
 int main(int argc, char ** argv) {
     // Parse arguments
@@ -308,6 +1527,23 @@ int main(int argc, char ** argv) {
         { 'x', "exponentFile", Arg_parser::yes },
         { 'l', "limit",        Arg_parser::yes },
         { 't', "threadCount",  Arg_parser::yes },
+        { 'b', "batch",        Arg_parser::no  },
+        { 'r', "range",        Arg_parser::yes },
+        { 'c', "checkpoint",   Arg_parser::yes },
+        { 'i', "checkpointInterval", Arg_parser::yes },
+        { OPT_RESUME, "resume", Arg_parser::no },
+        { 'e', "extend",       Arg_parser::yes },
+        { 'a', "stopWhenAbundant", Arg_parser::no },
+        { 'f', "factorCache",  Arg_parser::yes },
+        { 'o', "output",       Arg_parser::yes },
+        { 'j', "json",         Arg_parser::no  },
+        { 's', "sync",         Arg_parser::yes },
+        { 'p', "progress",     Arg_parser::yes },
+        { OPT_STATUS, "status", Arg_parser::yes },
+        { OPT_RHO, "rho",      Arg_parser::yes },
+        { OPT_PM1, "pm1",      Arg_parser::yes },
+        { OPT_FILTER, "filter", Arg_parser::yes },
+        { OPT_BENCH, "bench",  Arg_parser::no  },
         {   0, 0,              Arg_parser::no    }
     };
 
@@ -318,8 +1554,22 @@ int main(int argc, char ** argv) {
     }
 
     string exponentFilename = "";
+    string exponentRange = "";
+    string previousFilename = "";
+    string cacheFilename = "";
+    string outputFilename = "";
+    ResultWriter::Format outputFormat = ResultWriter::TEXT;
+    unsigned syncInterval = 0;
     uint64_t factoringLimit = DEFAULT_TF_LIMIT;
     uint64_t threadCount = 1;
+    bool batchMode = false;
+    bool stopWhenAbundant = false;
+    CheckpointSettings checkpoint;
+    checkpoint.interval = DEFAULT_CHECKPOINT_INTERVAL;
+    checkpoint.resume = false;
+    ProgressSettings progress;
+    progress.interval = 0;
+    FactoringBounds factoringBounds;
 
     int argind;
 
@@ -332,6 +1582,30 @@ int main(int argc, char ** argv) {
             case 'x': exponentFilename = parser.argument(argind); break;
             case 'l': factoringLimit = stol(parser.argument(argind)); break;
             case 't': threadCount = stol(parser.argument(argind)); break;
+            case 'b': batchMode = true; break;
+            case 'r': exponentRange = parser.argument(argind); batchMode = true; break;
+            case 'c': checkpoint.filename = parser.argument(argind); break;
+            case 'i': checkpoint.interval = stol(parser.argument(argind)); break;
+            case OPT_RESUME: checkpoint.resume = true; break;
+            case 'e': previousFilename = parser.argument(argind); break;
+            case 'a': stopWhenAbundant = true; break;
+            case 'f': cacheFilename = parser.argument(argind); break;
+            case 'o': outputFilename = parser.argument(argind); break;
+            case 'j': outputFormat = ResultWriter::JSON_LINES; break;
+            case 's': syncInterval = stoul(parser.argument(argind)); break;
+            case 'p': progress.interval = stoull(parser.argument(argind)); break;
+            case OPT_STATUS: progress.statusFilename = parser.argument(argind); break;
+            case OPT_RHO: factoringBounds.rhoIterations = stoull(parser.argument(argind)); break;
+            case OPT_PM1: factoringBounds.pm1Bound = stoull(parser.argument(argind)); break;
+            case OPT_FILTER:
+                if (parser.argument(argind) == "none") {
+                    powerFilters = NULL;
+                } else if (!(powerFilters = powerFilterKernels(parser.argument(argind).c_str()))) {
+                    cerr << "ERROR: screening kernel " << parser.argument(argind) << " isn't available on this CPU" << endl;
+                    return 1;
+                }
+                break;
+            case OPT_BENCH: runBenchmarks(); return 0;
             default :
                 cerr << "Uncaught option: " << code << endl;
         }
@@ -339,13 +1613,127 @@ int main(int argc, char ** argv) {
 
     string arg = parser.argument( argind++ );
     mpz_class base;
-    base.set_str(arg, 10);
+    if (!isnumber(arg) || base.set_str(arg, 10) != 0 || base < 2) {
+        cerr << "ERROR: invalid base: " << arg << endl;
+        print_help();
+        return 1;
+    }
+
+    // -p alone prints progress every so many seconds; --status writes it to a file instead, every minute by default
+    if (!progress.statusFilename.empty() && progress.interval == 0) {
+        progress.interval = DEFAULT_PROGRESS_INTERVAL;
+    }
+    ProgressSettings *progressSettings = progress.interval ? &progress : NULL;
+
+    if (checkpoint.resume && checkpoint.filename.empty()) {
+        cerr << "ERROR: --resume needs a checkpoint file (-c)" << endl;
+        return 1;
+    }
+
+    if (checkpoint.resume && !previousFilename.empty()) {
+        cerr << "ERROR: --resume and -e cannot be combined" << endl;
+        return 1;
+    }
+
+    FactorCache factorCache;
+    if (!cacheFilename.empty() && !factorCache.open(cacheFilename)) {
+        cerr << "ERROR: couldn't open factor cache " << cacheFilename << endl;
+        return 2;
+    }
+
+    ResultWriter output;
+    if ((batchMode || !outputFilename.empty()) && !output.open(outputFilename.empty() ? "-" : outputFilename, outputFormat, syncInterval)) {
+        cerr << "ERROR: couldn't open output file " << outputFilename << endl;
+        return 2;
+    }
+
+    if (batchMode) {
+        if (!checkpoint.filename.empty() || !previousFilename.empty()) {
+            cerr << "ERROR: checkpoints and extension are not supported in batch mode" << endl;
+            return 1;
+        }
+        vector<mpz_class> exponents;
+        mpz_class exponent;
+        for (; argind < parser.arguments(); ++argind) {
+            parseExponent(exponent, parser.argument(argind));
+            exponents.push_back(exponent);
+        }
+        if (!exponentFilename.empty()) {
+            ifstream exponentFile(exponentFilename);
+            if (!exponentFile.is_open()) {
+                cerr << "ERROR: couldn't open exponent file for reading!" << endl;
+                return 2;
+            }
+            string line;
+            while (getline(exponentFile, line)) {
+                if (line.find_first_not_of(" \t\r") == string::npos) continue;
+                parseExponent(exponent, line);
+                exponents.push_back(exponent);
+            }
+            exponentFile.close();
+        }
+        if (!exponentRange.empty() && !parseRange(exponents, exponentRange)) {
+            cerr << "ERROR: invalid exponent range: " << exponentRange << endl;
+            return 1;
+        }
+        if (exponents.empty()) {
+            cerr << "ERROR: Cannot find exponent!" << endl;
+            print_help();
+            return 1;
+        }
+
+        sort(exponents.begin(), exponents.end());
+        exponents.erase(unique(exponents.begin(), exponents.end()), exponents.end());
+
+        FactorList baseFactors;
+        simpleFactor(base, baseFactors, factoringBounds);
+        bool useCache = factorCache.isOpen() && cacheableBase(base, baseFactors);
+
+        // Only the exponents without a cached result for this limit go through the batch
+        vector<FactorList> resultFactors(exponents.size());
+        vector<mpz_class> uncachedExponents;
+        vector<FactorList>::size_type k;
+        for (k = 0; k < exponents.size(); k++) {
+            if (!useCache || factorCache.lookup(FactorCache::INDEX_ONE, base, exponents[k], factoringLimit, resultFactors[k]) < factoringLimit) {
+                uncachedExponents.push_back(exponents[k]);
+            }
+        }
+        vector<FactorList> batchFactors;
+        batchFactor(base, baseFactors, uncachedExponents, factoringLimit, batchFactors, threadCount, progressSettings);
+        vector<mpz_class>::size_type j = 0;
+        for (k = 0; k < exponents.size() && j < uncachedExponents.size(); k++) {
+            if (exponents[k] == uncachedExponents[j]) {
+                resultFactors[k].swap(batchFactors[j++]);
+                if (useCache) {
+                    factorCache.append(FactorCache::INDEX_ONE, base, exponents[k], factoringLimit, resultFactors[k]);
+                }
+            }
+        }
+
+        // One line per exponent, in ascending order
+        for (vector<mpz_class>::size_type k = 0; k < exponents.size(); k++) {
+            ResultRecord record;
+            record.layout = ResultRecord::TRIAL_FACTORS;
+            record.base = base;
+            record.exponent = exponents[k];
+            record.limit = factoringLimit;
+            record.hasAbundance = !resultFactors[k].empty();
+            record.abundant = isAbundant(resultFactors[k], record.abundance);
+            record.factors.swap(resultFactors[k]);
+            output.write(record);
+        }
+        if (!output.close()) {
+            cerr << "ERROR: couldn't write output file " << outputFilename << endl;
+            return 2;
+        }
+        return 0;
+    }
 
     mpz_class exponent;
-    vector<Factor> exponentFactors;
+    FactorList exponentFactors;
     arg = parser.argument( argind );
     if (!arg.empty()) {
-        parseExponent(exponentFactors, arg);
+        parseExponent(exponent, arg, exponentFactors);
     } else if (!exponentFilename.empty()) {
         ifstream exponentFile(exponentFilename);
         if (!exponentFile.is_open()) {
@@ -355,35 +1743,92 @@ int main(int argc, char ** argv) {
         string line;
         getline(exponentFile, line);
         exponentFile.close();
-        parseExponent(exponentFactors, line);
+        parseExponent(exponent, line, exponentFactors);
     } else {
         cerr << "ERROR: Cannot find exponent!" << endl;
         print_help();
         return 1;
     }
-    multiply(exponentFactors, exponent);
 
-    vector<Factor> baseFactors;
-    simpleFactor(base, baseFactors, factoringLimit);
+    // Only the primes above an earlier run's limit need testing
+    FactorList resultFactors;
+    uint64_t previousLimit = 0;
+    if (!previousFilename.empty()) {
+        mpz_class previousBase = base, previousExponent = exponent;
+        if (!loadPreviousResults(previousFilename, previousBase, previousExponent, previousLimit, resultFactors)) {
+            cerr << "ERROR: couldn't read previous results from " << previousFilename << endl;
+            return 2;
+        }
+        if (previousBase != base || previousExponent != exponent) {
+            cerr << "ERROR: previous results are for " << previousBase << "^" << previousExponent << endl;
+            return 2;
+        }
+        if (previousLimit > factoringLimit) {
+            cerr << "ERROR: previous results already go up to limit=" << previousLimit << endl;
+            return 1;
+        }
+    }
+
+    FactorList baseFactors;
+    simpleFactor(base, baseFactors, factoringBounds);
+    bool useCache = factorCache.isOpen() && cacheableBase(base, baseFactors);
+
+    // A cached result covers every prime up to its limit, like an earlier run given with -e
+    bool fromCache = false;
+    if (useCache && previousFilename.empty() && !checkpoint.resume) {
+        FactorList cachedFactors;
+        uint64_t cachedLimit = factorCache.lookup(FactorCache::INDEX_ONE, base, exponent, factoringLimit, cachedFactors);
+        if (cachedLimit > previousLimit) {
+            resultFactors.swap(cachedFactors);
+            previousLimit = cachedLimit;
+            fromCache = cachedLimit == factoringLimit;
+        }
+    }
 
-    vector<Factor> resultFactors;
-    uint64_t totalFactorCount = fullFactor(base, baseFactors, exponent, factoringLimit, resultFactors, threadCount);
-    vector<Factor>::size_type uniqueFactorCount = resultFactors.size();
+    uint64_t abundantPrime = 0;
+    uint64_t totalFactorCount = 0;
+    if (!fromCache) {
+        totalFactorCount = fullFactor(base, baseFactors, exponent, factoringLimit, resultFactors, threadCount, checkpoint.filename.empty() ? NULL : &checkpoint, previousLimit, stopWhenAbundant, &abundantPrime, progressSettings, &exponentFactors);
+        if (useCache && !abundantPrime) {
+            factorCache.append(FactorCache::INDEX_ONE, base, exponent, factoringLimit, resultFactors);
+        }
+    }
+    size_t uniqueFactorCount = resultFactors.size();
 
     if (resultFactors.empty()) {
-        cout << "No factors found up to given limit." << endl;
+        cout << "No factors found up to limit=" << factoringLimit << "." << endl;
+        cout << "Index 1 of " << base.get_str() << "^" << exponent << " has no factors below the limit." << endl;
+    } else if (abundantPrime) {
+        // Not every prime below the limit was tested, so this is no "remainder up to limit" line
+        cout << "Abundance established by factor " << abundantPrime << "; stopped before limit=" << factoringLimit << endl;
+        cout << "d = " << resultFactors.toString() << " * remainder" << endl;
     } else {
-        string resultFactorString = getBaseFactorString(resultFactors);
+        string resultFactorString = resultFactors.toString();
         cout << "d = " << resultFactorString << " * remainder up to limit=" << factoringLimit << endl;
+    }
 
-        mpz_class n, s, partial;
-        sigma(resultFactors, s, partial); //calculate sigma(n) and partial = product(factors)
-        n = s - partial;
-        mpq_class abundance(n, partial);
-        if (cmp(abundance, 1) > 0) {
-            cout << "Index 1 of " << base.get_str() << "^" << exponent << " is abundant! (" << abundance.get_d() << ")" << endl;
+    if (!resultFactors.empty()) {
+        double abundance;
+        if (isAbundant(resultFactors, abundance)) {
+            cout << "Index 1 of " << base.get_str() << "^" << exponent << " is abundant! (" << abundance << ")" << endl;
         } else {
-            cout << "Index 1 of " << base.get_str() << "^" << exponent << " is not abundant. (" << abundance.get_d() << ")" << endl;
+            cout << "Index 1 of " << base.get_str() << "^" << exponent << " is not abundant. (" << abundance << ")" << endl;
+        }
+    }
+
+    if (output.isOpen()) {
+        ResultRecord record;
+        record.layout = ResultRecord::TRIAL_FACTORS;
+        record.base = base;
+        record.exponent = exponent;
+        record.limit = abundantPrime ? 0 : factoringLimit;
+        record.hasAbundance = !resultFactors.empty();
+        record.abundant = isAbundant(resultFactors, record.abundance);
+        record.factors = resultFactors;
+        output.write(record);
+        if (!output.close()) {
+            cerr << "ERROR: couldn't write output file " << outputFilename << endl;
+            return 2;
         }
     }
 
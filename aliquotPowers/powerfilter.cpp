@@ -0,0 +1,83 @@
+/* Lane-parallel screening of small primes for powerTrialFactoring: the
+ * scalar kernel and the run-time choice between it and the vector builds.
+ *
+ * (C) Alexander Jones, 2021. My own code is under the MIT License, which is
+ * included in this repository.
+ */
+
+#include "powerfilter.h"
+#include "powerfilterkernel.h"
+
+#include <cstring>
+
+// One prime at a time, for CPUs without a vector build
+struct ScalarLanes {
+    typedef uint64_t Vector;
+    enum { LANES = 1 };
+
+    static inline Vector load(const uint64_t *a) {
+        return *a;
+    }
+
+    static inline Vector multiply(Vector a, Vector b, Vector p, Vector inverse) {
+        uint64_t t = a * b;
+        uint64_t m = (uint32_t) ((uint32_t) t * (uint32_t) inverse);
+        uint64_t high = t >> 32, mpHigh = (m * p) >> 32;
+        return high >= mpHigh ? high - mpHigh : high - mpHigh + p;
+    }
+
+    static inline Vector add(Vector a, Vector b, Vector p) {
+        Vector sum = a + b;
+        return sum >= p ? sum - p : sum;
+    }
+
+    static inline Vector subtract(Vector a, Vector b, Vector p) {
+        return a >= b ? a - b : a - b + p;
+    }
+
+    static inline uint32_t equal(Vector a, Vector b) {
+        return a == b;
+    }
+};
+
+static const PowerFilterKernel scalarPowerFilters[POWER_FILTER_SHAPES] = POWER_FILTER_TABLE(ScalarLanes);
+
+#ifdef __x86_64__
+extern const PowerFilterKernel avx2PowerFilters[POWER_FILTER_SHAPES];
+extern const PowerFilterKernel avx512PowerFilters[POWER_FILTER_SHAPES];
+#endif
+
+const PowerFilterKernel *powerFilterKernels(const char *name) {
+#ifdef __x86_64__
+    __builtin_cpu_init();
+    if (strcmp(name, "avx512") == 0) {
+        return __builtin_cpu_supports("avx512f") ? avx512PowerFilters : NULL;
+    }
+    if (strcmp(name, "avx2") == 0) {
+        return __builtin_cpu_supports("avx2") ? avx2PowerFilters : NULL;
+    }
+#endif
+    return strcmp(name, "scalar") == 0 ? scalarPowerFilters : NULL;
+}
+
+const char *bestPowerFilter() {
+    if (powerFilterKernels("avx512")) {
+        return "avx512";
+    }
+    if (powerFilterKernels("avx2")) {
+        return "avx2";
+    }
+    return "scalar";
+}
+
+PowerFilterShape powerFilterShape(const PowerFilterData & data) {
+    if (data.basePrimeCount == 1 && data.basePrimes[0] == 2 && data.multiplicities[0] == 1) {
+        return POWER_FILTER_BASE_TWO;
+    }
+    switch (data.basePrimeCount) {
+        case 1: return POWER_FILTER_ONE_PRIME;
+        case 2: return POWER_FILTER_TWO_PRIMES;
+        case 3: return POWER_FILTER_THREE_PRIMES;
+        default: return POWER_FILTER_ANY_PRIMES;
+    }
+}
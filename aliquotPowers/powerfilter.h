@@ -0,0 +1,66 @@
+/* Lane-parallel screening of small primes for powerTrialFactoring.
+ *
+ * A prime p divides index 1 of b^e only if product((q^(e+1) - 1)^k) is
+ * congruent to b^e * D modulo p alone, over the base factorization b =
+ * product(q^k) with D = product((q - 1)^k). For primes below 2^32 that
+ * condition needs only 32-bit Montgomery arithmetic, and the exponent is the
+ * same for every prime, so a block of primes is screened together, one prime
+ * per lane with the exponent's bits shared. Only the primes passing the
+ * screen, nearly all of them real divisors, go on to the exact test modulo
+ * D * p^k.
+ *
+ * The kernel is built for scalar code, AVX2 (4 lanes) and AVX-512 (8 lanes),
+ * each working through the whole block, and the widest one the CPU supports
+ * is chosen at run time. Each build has a table of kernels for the common
+ * shapes of base: 2, where the test is 2^e = 1 (mod p) by doublings, and one
+ * to three distinct primes, with their loops fixed at compile time. Any other
+ * base goes to the generic kernel.
+ *
+ * (C) Alexander Jones, 2021. My own code is under the MIT License, which is
+ * included in this repository.
+ */
+
+#ifndef POWERFILTER_H
+#define POWERFILTER_H
+
+#include <cstdint>
+#include <cstddef>
+
+#define POWER_FILTER_BLOCK 16 // primes per kernel call
+#define POWER_FILTER_MAX_BASE_PRIMES 8
+
+// What the screen needs of index 1 of b^e, for a base of word-sized primes
+struct PowerFilterData {
+    const uint64_t *exponentLimbs; // e in little-endian 64-bit limbs, the highest nonzero
+    size_t exponentLimbCount;
+    uint64_t basePrimes[POWER_FILTER_MAX_BASE_PRIMES];
+    uint64_t multiplicities[POWER_FILTER_MAX_BASE_PRIMES];
+    size_t basePrimeCount;
+    uint64_t divisorLow; // D
+    uint64_t divisorHigh;
+};
+
+// Bit i of the result is set if primes[i] passes the screen, for count <= POWER_FILTER_BLOCK odd primes
+// below 2^32
+typedef uint32_t (*PowerFilterKernel)(const PowerFilterData & data, const uint32_t *primes, int count);
+
+// Kernels by the shape of the base
+enum PowerFilterShape {
+    POWER_FILTER_BASE_TWO,
+    POWER_FILTER_ONE_PRIME,
+    POWER_FILTER_TWO_PRIMES,
+    POWER_FILTER_THREE_PRIMES,
+    POWER_FILTER_ANY_PRIMES,
+    POWER_FILTER_SHAPES
+};
+
+// The table of kernels of the given build ("avx512", "avx2" or "scalar") if this CPU can run it, otherwise NULL
+const PowerFilterKernel *powerFilterKernels(const char *name);
+
+// The shape of kernel for a base
+PowerFilterShape powerFilterShape(const PowerFilterData & data);
+
+// The name of the widest kernel this CPU can run
+const char *bestPowerFilter();
+
+#endif
@@ -0,0 +1,47 @@
+/* The AVX2 build of the power filter kernel, four primes per vector. Built
+ * with -mavx2 and only called once the CPU is known to support it.
+ *
+ * (C) Alexander Jones, 2021. My own code is under the MIT License, which is
+ * included in this repository.
+ */
+
+#include "powerfilterkernel.h"
+
+#include <immintrin.h>
+
+struct Avx2Lanes {
+    typedef __m256i Vector;
+    enum { LANES = 4 };
+
+    static inline Vector load(const uint64_t *a) {
+        return _mm256_load_si256((const __m256i *) a);
+    }
+
+    static inline Vector multiply(Vector a, Vector b, Vector p, Vector inverse) {
+        Vector t = _mm256_mul_epu32(a, b);
+        Vector m = _mm256_mul_epu32(t, inverse);
+        Vector high = _mm256_srli_epi64(t, 32);
+        Vector mpHigh = _mm256_srli_epi64(_mm256_mul_epu32(m, p), 32);
+        // Both halves are below 2^32, so the signed comparison is exact
+        Vector borrow = _mm256_cmpgt_epi64(mpHigh, high);
+        return _mm256_add_epi64(_mm256_sub_epi64(high, mpHigh), _mm256_and_si256(borrow, p));
+    }
+
+    static inline Vector add(Vector a, Vector b, Vector p) {
+        // The sum is below 2^33, so the signed comparison is exact
+        Vector sum = _mm256_add_epi64(a, b);
+        Vector below = _mm256_cmpgt_epi64(p, sum);
+        return _mm256_sub_epi64(sum, _mm256_andnot_si256(below, p));
+    }
+
+    static inline Vector subtract(Vector a, Vector b, Vector p) {
+        Vector borrow = _mm256_cmpgt_epi64(b, a);
+        return _mm256_add_epi64(_mm256_sub_epi64(a, b), _mm256_and_si256(borrow, p));
+    }
+
+    static inline uint32_t equal(Vector a, Vector b) {
+        return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(a, b)));
+    }
+};
+
+extern const PowerFilterKernel avx2PowerFilters[POWER_FILTER_SHAPES] = POWER_FILTER_TABLE(Avx2Lanes);
@@ -0,0 +1,44 @@
+/* The AVX-512 build of the power filter kernel, eight primes per vector.
+ * Built with -mavx512f and only called once the CPU is known to support it.
+ *
+ * (C) Alexander Jones, 2021. My own code is under the MIT License, which is
+ * included in this repository.
+ */
+
+#include "powerfilterkernel.h"
+
+#include <immintrin.h>
+
+struct Avx512Lanes {
+    typedef __m512i Vector;
+    enum { LANES = 8 };
+
+    static inline Vector load(const uint64_t *a) {
+        return _mm512_load_si512((const void *) a);
+    }
+
+    static inline Vector multiply(Vector a, Vector b, Vector p, Vector inverse) {
+        Vector t = _mm512_mul_epu32(a, b);
+        Vector m = _mm512_mul_epu32(t, inverse);
+        Vector high = _mm512_srli_epi64(t, 32);
+        Vector mpHigh = _mm512_srli_epi64(_mm512_mul_epu32(m, p), 32);
+        Vector difference = _mm512_sub_epi64(high, mpHigh);
+        return _mm512_mask_add_epi64(difference, _mm512_cmplt_epu64_mask(high, mpHigh), difference, p);
+    }
+
+    static inline Vector add(Vector a, Vector b, Vector p) {
+        Vector sum = _mm512_add_epi64(a, b);
+        return _mm512_mask_sub_epi64(sum, _mm512_cmpge_epu64_mask(sum, p), sum, p);
+    }
+
+    static inline Vector subtract(Vector a, Vector b, Vector p) {
+        Vector difference = _mm512_sub_epi64(a, b);
+        return _mm512_mask_add_epi64(difference, _mm512_cmplt_epu64_mask(a, b), difference, p);
+    }
+
+    static inline uint32_t equal(Vector a, Vector b) {
+        return _mm512_cmpeq_epu64_mask(a, b);
+    }
+};
+
+extern const PowerFilterKernel avx512PowerFilters[POWER_FILTER_SHAPES] = POWER_FILTER_TABLE(Avx512Lanes);
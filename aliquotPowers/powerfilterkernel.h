@@ -0,0 +1,182 @@
+/* The power filter kernel, shared by its scalar, AVX2 and AVX-512 builds.
+ *
+ * Each build includes this file with its own lane operations, in a
+ * translation unit compiled for that instruction set. Everything here either
+ * has internal linkage or depends on the lane type, so the linker can never
+ * substitute one build's code for another's.
+ *
+ * Lanes are 64 bits wide and hold values below their odd prime p < 2^32.
+ * Multiplication is Montgomery's with R = 2^32, computed as in montgomery.h.
+ * The lane type Lanes provides:
+ *
+ *   Vector, LANES                  the vector type and its lane count
+ *   load(const uint64_t *)         aligned load of LANES values
+ *   multiply(a, b, p, inverse)     a * b / R mod p, for inverse = p^-1 mod R
+ *   add(a, b, p)                   a + b mod p
+ *   subtract(a, b, p)              a - b mod p
+ *   equal(a, b)                    a bit per lane, set where a == b
+ *
+ * (C) Alexander Jones, 2021. My own code is under the MIT License, which is
+ * included in this repository.
+ */
+
+#ifndef POWERFILTERKERNEL_H
+#define POWERFILTERKERNEL_H
+
+#include "powerfilter.h"
+
+// Raise every lane of a to the same small power
+template <typename Lanes>
+static inline typename Lanes::Vector lanePower(typename Lanes::Vector a, typename Lanes::Vector one, uint64_t exponent,
+                                               typename Lanes::Vector p, typename Lanes::Vector inverse) {
+    typename Lanes::Vector result = one;
+    for (; exponent; exponent >>= 1) {
+        if (exponent & 1) {
+            result = Lanes::multiply(result, a, p, inverse);
+        }
+        if (exponent > 1) {
+            a = Lanes::multiply(a, a, p, inverse);
+        }
+    }
+    return result;
+}
+
+// Per-lane Newton iteration for p^-1 mod R, correct to 3 bits to start with; each step doubles that
+static inline uint32_t laneInverse(uint32_t p) {
+    uint32_t inverse = p;
+    for (int bits = 3; bits < 32; bits *= 2) {
+        inverse *= 2 - p * inverse;
+    }
+    return inverse;
+}
+
+// Base 2 alone, the commonest: index 1 is 2^e - 1, so the screen is exact and p passes if 2^e = 1 (mod p).
+// Multiplying by the base is a doubling, and only R mod p (the Montgomery form of 1) takes a division.
+template <typename Lanes>
+static uint32_t powerFilterBaseTwo(const PowerFilterData & data, const uint32_t *primes, int count) {
+    typedef typename Lanes::Vector Vector;
+    const int vectors = POWER_FILTER_BLOCK / Lanes::LANES;
+
+    alignas(64) uint64_t lanePrime[POWER_FILTER_BLOCK];
+    alignas(64) uint64_t laneInverses[POWER_FILTER_BLOCK];
+    alignas(64) uint64_t laneOne[POWER_FILTER_BLOCK];
+    for (int i = 0; i < POWER_FILTER_BLOCK; i++) {
+        uint64_t p = i < count ? primes[i] : 3;
+        lanePrime[i] = p;
+        laneInverses[i] = laneInverse((uint32_t) p);
+        laneOne[i] = ((uint64_t) 1 << 32) % p;
+    }
+
+    uint32_t passed = 0;
+    for (int v = 0; v < vectors; v++) {
+        int offset = v * Lanes::LANES;
+        if (offset >= count) {
+            break;
+        }
+        Vector p = Lanes::load(lanePrime + offset);
+        Vector inverse = Lanes::load(laneInverses + offset);
+        Vector one = Lanes::load(laneOne + offset);
+        Vector power = Lanes::add(one, one, p);
+        size_t limb = data.exponentLimbCount - 1;
+        int bit = 62 - __builtin_clzll(data.exponentLimbs[limb]);
+        while (true) {
+            for (; bit >= 0; bit--) {
+                power = Lanes::multiply(power, power, p, inverse);
+                if ((data.exponentLimbs[limb] >> bit) & 1) {
+                    power = Lanes::add(power, power, p);
+                }
+            }
+            if (limb-- == 0) {
+                break;
+            }
+            bit = 63;
+        }
+        passed |= Lanes::equal(power, one) << offset;
+    }
+    return count < 32 ? passed & ((1u << count) - 1) : passed;
+}
+
+// Any base, with BaseCount distinct primes fixed at compile time, or given by data if BaseCount is 0
+template <typename Lanes, int BaseCount>
+static uint32_t powerFilterBlock(const PowerFilterData & data, const uint32_t *primes, int count) {
+    typedef typename Lanes::Vector Vector;
+    const int vectors = POWER_FILTER_BLOCK / Lanes::LANES;
+    const size_t baseCount = BaseCount ? BaseCount : data.basePrimeCount;
+
+    // Per-lane constants, p^-1 mod R and R^2 = 2^64 mod p, the one division per prime; unused lanes get p = 3
+    alignas(64) uint64_t lanePrime[POWER_FILTER_BLOCK];
+    alignas(64) uint64_t laneInverses[POWER_FILTER_BLOCK];
+    alignas(64) uint64_t laneRSquared[POWER_FILTER_BLOCK];
+    alignas(64) uint64_t laneOne[POWER_FILTER_BLOCK];
+    alignas(64) uint64_t laneResidue[POWER_FILTER_MAX_BASE_PRIMES + 1][POWER_FILTER_BLOCK];
+    for (int i = 0; i < POWER_FILTER_BLOCK; i++) {
+        uint64_t p = i < count ? primes[i] : 3;
+        uint64_t rSquared = (0 - p) % p;
+        lanePrime[i] = p;
+        laneInverses[i] = laneInverse((uint32_t) p);
+        laneRSquared[i] = rSquared;
+        laneOne[i] = 1;
+        for (size_t j = 0; j < baseCount; j++) {
+            uint64_t q = data.basePrimes[j];
+            laneResidue[j][i] = q < p ? q : q % p;
+        }
+        // D mod p = (high * 2^64 + low) mod p, with 2^64 mod p at hand
+        uint64_t low = data.divisorLow < p ? data.divisorLow : data.divisorLow % p;
+        uint64_t high = data.divisorHigh % p;
+        laneResidue[baseCount][i] = (high * rSquared % p + low) % p;
+    }
+
+    uint32_t passed = 0;
+    for (int v = 0; v < vectors; v++) {
+        int offset = v * Lanes::LANES;
+        if (offset >= count) {
+            break;
+        }
+        Vector p = Lanes::load(lanePrime + offset);
+        Vector inverse = Lanes::load(laneInverses + offset);
+        Vector rSquared = Lanes::load(laneRSquared + offset);
+        Vector one = Lanes::multiply(rSquared, Lanes::load(laneOne + offset), p, inverse);
+
+        // q^e for every base prime q, with the exponent's bits shared by the lanes and the base primes
+        Vector base[POWER_FILTER_MAX_BASE_PRIMES], power[POWER_FILTER_MAX_BASE_PRIMES];
+        for (size_t j = 0; j < baseCount; j++) {
+            base[j] = Lanes::multiply(Lanes::load(laneResidue[j] + offset), rSquared, p, inverse);
+            power[j] = base[j];
+        }
+        size_t limb = data.exponentLimbCount - 1;
+        int bit = 62 - __builtin_clzll(data.exponentLimbs[limb]);
+        while (true) {
+            for (; bit >= 0; bit--) {
+                bool set = (data.exponentLimbs[limb] >> bit) & 1;
+                for (size_t j = 0; j < baseCount; j++) {
+                    power[j] = Lanes::multiply(power[j], power[j], p, inverse);
+                    if (set) {
+                        power[j] = Lanes::multiply(power[j], base[j], p, inverse);
+                    }
+                }
+            }
+            if (limb-- == 0) {
+                break;
+            }
+            bit = 63;
+        }
+
+        // product((q^(e+1) - 1)^k) against b^e * D = product(q^(e*k)) * D
+        Vector firstAddend = one, basePower = one;
+        for (size_t j = 0; j < baseCount; j++) {
+            Vector term = Lanes::subtract(Lanes::multiply(power[j], base[j], p, inverse), one, p);
+            firstAddend = Lanes::multiply(firstAddend, lanePower<Lanes>(term, one, data.multiplicities[j], p, inverse), p, inverse);
+            basePower = Lanes::multiply(basePower, lanePower<Lanes>(power[j], one, data.multiplicities[j], p, inverse), p, inverse);
+        }
+        Vector divisor = Lanes::multiply(Lanes::load(laneResidue[baseCount] + offset), rSquared, p, inverse);
+        Vector secondAddend = Lanes::multiply(basePower, divisor, p, inverse);
+        passed |= Lanes::equal(firstAddend, secondAddend) << offset;
+    }
+    return count < 32 ? passed & ((1u << count) - 1) : passed;
+}
+
+// A build's dispatch table, in PowerFilterShape order
+#define POWER_FILTER_TABLE(Lanes) { powerFilterBaseTwo<Lanes>, powerFilterBlock<Lanes, 1>, powerFilterBlock<Lanes, 2>, \
+                                    powerFilterBlock<Lanes, 3>, powerFilterBlock<Lanes, 0> }
+
+#endif
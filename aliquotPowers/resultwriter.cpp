@@ -0,0 +1,224 @@
+/* Buffered result output for the aliquot power tools.
+ *
+ * (C) Alexander Jones, 2021. My own code is under the MIT License, which is
+ * included in this repository.
+ */
+
+#include "resultwriter.h"
+
+#include <chrono>
+#include <cinttypes>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+#define QUEUE_CAPACITY 4096
+#define FILE_BUFFER_SIZE (1 << 16)
+
+ResultWriter::ResultWriter() : file(NULL), ownFile(false), format(TEXT), syncInterval(0), failed(false), closing(false) {
+}
+
+ResultWriter::~ResultWriter() {
+    close();
+}
+
+bool ResultWriter::open(const string & filename, Format format, unsigned syncInterval, bool append) {
+    if (filename == "-") {
+        file = stdout;
+        ownFile = false;
+    } else {
+        file = fopen(filename.c_str(), append ? "a" : "w");
+        ownFile = true;
+        if (file == NULL) {
+            return false;
+        }
+        setvbuf(file, NULL, _IOFBF, FILE_BUFFER_SIZE);
+    }
+    this->format = format;
+    this->syncInterval = syncInterval;
+    failed = false;
+    closing = false;
+    writer = thread(&ResultWriter::run, this);
+    return true;
+}
+
+void ResultWriter::write(ResultRecord & record) {
+    unique_lock<mutex> lock(queueMutex);
+    dequeued.wait(lock, [this] { return queue.size() < QUEUE_CAPACITY; });
+    queue.push_back(ResultRecord());
+    swap(queue.back(), record);
+    queued.notify_one();
+}
+
+bool ResultWriter::close() {
+    if (file == NULL) {
+        return !failed;
+    }
+    {
+        lock_guard<mutex> lock(queueMutex);
+        closing = true;
+    }
+    queued.notify_one();
+    writer.join();
+
+    sync();
+    if (ownFile && fclose(file) != 0) {
+        failed = true;
+    }
+    file = NULL;
+    return !failed;
+}
+
+// Takes whatever is queued at each wakeup, so the queue lock is never held while writing
+void ResultWriter::run() {
+    chrono::steady_clock::time_point nextSync = chrono::steady_clock::now() + chrono::seconds(syncInterval);
+    deque<ResultRecord> batch;
+    unique_lock<mutex> lock(queueMutex);
+    while (true) {
+        if (syncInterval) {
+            queued.wait_until(lock, nextSync, [this] { return !queue.empty() || closing; });
+        } else {
+            queued.wait(lock, [this] { return !queue.empty() || closing; });
+        }
+        batch.swap(queue);
+        bool finished = closing;
+        lock.unlock();
+        dequeued.notify_all();
+
+        for (deque<ResultRecord>::size_type i = 0; i < batch.size(); i++) {
+            render(batch[i]);
+        }
+        batch.clear();
+        if (ferror(file)) {
+            failed = true;
+        }
+        if (syncInterval && chrono::steady_clock::now() >= nextSync) {
+            sync();
+            nextSync = chrono::steady_clock::now() + chrono::seconds(syncInterval);
+        }
+
+        lock.lock();
+        if (finished && queue.empty()) {
+            return;
+        }
+    }
+}
+
+void ResultWriter::sync() {
+    if (fflush(file) != 0) {
+        failed = true;
+    }
+    // Pipes and terminals cannot be synced, and need not be
+    struct stat info;
+    if (fstat(fileno(file), &info) == 0 && S_ISREG(info.st_mode) && fsync(fileno(file)) != 0) {
+        failed = true;
+    }
+}
+
+// Factors as "p * q^k", or as JSON [["p", 1], ["q", k]]
+void ResultWriter::renderFactors(const ResultRecord & record) {
+    const FactorList & factors = record.factors;
+    for (size_t i = 0; i < factors.size(); i++) {
+        if (format == JSON_LINES) {
+            fputs(i ? ", [\"" : "[\"", file);
+        } else if (i) {
+            fputs(" * ", file);
+        }
+        if (factors.isWord(i)) {
+            fprintf(file, "%" PRIu64, factors.word(i));
+        } else {
+            mpz_out_str(file, 10, factors.prime(i).get_mpz_t());
+        }
+        if (format == JSON_LINES) {
+            fprintf(file, "\", %" PRIu64 "]", factors.multiplicity(i));
+        } else if (factors.multiplicity(i) > 1) {
+            fprintf(file, "^%" PRIu64, factors.multiplicity(i));
+        }
+    }
+}
+
+// A verification report line
+void ResultWriter::renderVerification(const ResultRecord & record) {
+    if (format == JSON_LINES) {
+        if (!record.error.empty()) {
+            fprintf(file, "{\"pass\": false, \"error\": \"%s\"}\n", record.error.c_str());
+            return;
+        }
+        fputs("{\"base\": \"", file);
+        mpz_out_str(file, 10, record.base.get_mpz_t());
+        fputs("\", \"exponent\": \"", file);
+        mpz_out_str(file, 10, record.exponent.get_mpz_t());
+        fprintf(file, "\", \"pass\": %s, \"abundant\": %s, \"abundance\": %.17g, \"nonDividing\": [",
+                record.passed ? "true" : "false", record.abundant ? "true" : "false", record.abundance);
+        renderFactors(record);
+        fputs("]}\n", file);
+        return;
+    }
+
+    if (!record.error.empty()) {
+        fprintf(file, "FAIL %s\n", record.error.c_str());
+        return;
+    }
+    mpz_out_str(file, 10, record.base.get_mpz_t());
+    fputc(' ', file);
+    mpz_out_str(file, 10, record.exponent.get_mpz_t());
+    fprintf(file, record.abundant ? ": %s (abundant! %g" : ": %s (not abundant, %g", record.passed ? "PASS" : "FAIL", record.abundance);
+    if (!record.factors.empty()) {
+        fputs("; does not divide: ", file);
+        renderFactors(record);
+    }
+    fputs(")\n", file);
+}
+
+void ResultWriter::render(const ResultRecord & record) {
+    if (record.layout == ResultRecord::VERIFICATION) {
+        renderVerification(record);
+    } else if (format == JSON_LINES) {
+        fputs("{\"base\": \"", file);
+        mpz_out_str(file, 10, record.base.get_mpz_t());
+        fputs("\", \"exponent\": \"", file);
+        mpz_out_str(file, 10, record.exponent.get_mpz_t());
+        fputs("\", \"factors\": [", file);
+        renderFactors(record);
+        fputc(']', file);
+        if (record.limit) {
+            fprintf(file, ", \"limit\": %" PRIu64, record.limit);
+        }
+        if (record.layout == ResultRecord::ABUNDANT_EXPONENT) {
+            fputs(", \"abundant\": true", file);
+        } else if (record.hasAbundance) {
+            fprintf(file, ", \"abundant\": %s", record.abundant ? "true" : "false");
+        }
+        if (record.hasAbundance) {
+            fprintf(file, ", \"abundance\": %.17g", record.abundance);
+        }
+        fputs("}\n", file);
+    } else if (record.layout == ResultRecord::ABUNDANT_EXPONENT) {
+        mpz_out_str(file, 10, record.base.get_mpz_t());
+        fputc(' ', file);
+        mpz_out_str(file, 10, record.exponent.get_mpz_t());
+        fputs(" (", file);
+        renderFactors(record);
+        fputs(")\n", file);
+    } else {
+        mpz_out_str(file, 10, record.base.get_mpz_t());
+        fputc('^', file);
+        mpz_out_str(file, 10, record.exponent.get_mpz_t());
+        if (record.factors.empty()) {
+            fprintf(file, ": no factors found up to limit=%" PRIu64 "\n", record.limit);
+            return;
+        }
+        fputs(": d = ", file);
+        renderFactors(record);
+        fputs(" * remainder", file);
+        if (record.limit) {
+            fprintf(file, " up to limit=%" PRIu64, record.limit);
+        }
+        if (record.hasAbundance) {
+            fprintf(file, record.abundant ? " (abundant! %g)" : " (not abundant, %g)", record.abundance);
+        }
+        fputc('\n', file);
+    }
+}
@@ -0,0 +1,89 @@
+/* Buffered result output for the aliquot power tools.
+ *
+ * Results are handed to a background thread through a bounded queue and
+ * rendered straight into a block-buffered file, either as the tools' usual
+ * text lines or as JSON lines. The file is synced every few seconds if asked
+ * to, and always when it is closed.
+ *
+ * (C) Alexander Jones, 2021. My own code is under the MIT License, which is
+ * included in this repository.
+ */
+
+#ifndef RESULTWRITER_H
+#define RESULTWRITER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include <gmpxx.h>
+
+#include "factorlist.h"
+
+// One result line
+struct ResultRecord {
+    enum Layout {
+        ABUNDANT_EXPONENT, // powerAbundance's log: "<base> <exponent> (<factors>)"
+        TRIAL_FACTORS,     // powerTrialFactoring: "<base>^<exponent>: d = <factors> * remainder up to limit=<limit> (...)"
+        VERIFICATION       // verifyPrimePowerAbundance: "<base> <exponent>: PASS|FAIL (...)", factors are the ones not dividing
+    };
+
+    Layout layout = ABUNDANT_EXPONENT;
+    mpz_class base;
+    mpz_class exponent;
+    FactorList factors;
+    uint64_t limit = 0; // every prime below it was tried; 0 if the search stopped early
+    bool hasAbundance = false;
+    bool abundant = false; // sigma(d) > 2d, decided exactly
+    double abundance = 0; // sigma(d) / d - 1 for the factors found
+    bool passed = false; // VERIFICATION: abundant, and every factor divides
+    std::string error; // VERIFICATION: why the record could not be checked, if it could not
+};
+
+class ResultWriter {
+public:
+    enum Format { TEXT, JSON_LINES };
+
+    ResultWriter();
+    ~ResultWriter();
+
+    // Open filename ("-" for standard output) for appending, or truncated if not append;
+    // syncInterval is the number of seconds between syncs, 0 to sync only on close
+    bool open(const std::string & filename, Format format = TEXT, unsigned syncInterval = 0, bool append = true);
+    bool isOpen() const { return file != NULL; }
+
+    // Queue a record, taking its contents; blocks while the queue is full
+    void write(ResultRecord & record);
+
+    // Write out everything queued and sync; false if anything failed to be written
+    bool close();
+
+private:
+    FILE *file;
+    bool ownFile;
+    Format format;
+    unsigned syncInterval;
+    bool failed;
+
+    std::deque<ResultRecord> queue;
+    std::mutex queueMutex;
+    std::condition_variable queued;
+    std::condition_variable dequeued;
+    bool closing;
+    std::thread writer;
+
+    void run();
+    void render(const ResultRecord & record);
+    void renderFactors(const ResultRecord & record);
+    void renderVerification(const ResultRecord & record);
+    void sync();
+
+    ResultWriter(const ResultWriter &);
+    ResultWriter & operator=(const ResultWriter &);
+};
+
+#endif
@@ -1,7 +1,9 @@
 /* Aliquot prime power abundance verifier.
  *
  * This program verifies the divisibility and abundance of a set of divisors in
- * relation to a given prime base and exponent pair.
+ * relation to a given prime base and exponent pair. In batch mode it verifies
+ * a file of such records, as logged by the other tools, across several threads
+ * and writes a pass/fail report.
  *
  * (C) Alexander Jones, 2021. My code is under the MIT License, which is
  * included in this repository.
@@ -12,119 +14,359 @@
  * disclaimer of warranty.
  */
 
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <atomic>
+#include <thread>
 
 #include <gmpxx.h>
 
-using namespace std;
+#include "arg_parser.h"
+#include "factorlist.h"
+#include "factorcache.h"
+#include "resultwriter.h"
+#include "abundance.h"
 
-typedef vector<pair<mpz_class, int> > FactorVector;
+using namespace std;
 
-// adds <factor> to <factors>
+//reads the partial factorization from 'partial_factors', one factor per line
 
-void found_factor(mpz_class & factor, FactorVector & factors, int exponent = 1) {
-    factors.push_back(make_pair(factor, exponent));
-}
-
-void load_factors(FactorVector & factors) {
+void load_factors(FactorList & factors) {
     ifstream factorFile("partial_factors");
     if (!factorFile.is_open()) {
         cout << "WARNING: couldn't open input file for reading!" << endl;
         exit(1);
     }
-    string line;
+    string line, text;
     while (getline(factorFile, line)) {
-        mpz_class factor;
-        int caretIndex = line.find("^");
-        int power;
-        if (caretIndex == string::npos) {
-            factor.set_str(line, 10);
-            power = 1;
-        } else {
-            factor.set_str(line.substr(0, caretIndex), 10);
-            power = stoi(line.substr(caretIndex + 1));
-        }
-        found_factor(factor, factors, power);
+        text += line + " * ";
     }
     factorFile.close();
+    if (!factors.parse(text)) {
+        cout << "WARNING: couldn't parse input file!" << endl;
+        exit(1);
+    }
+}
+
+//loads the best cached factorization of index 1 of <base>^<exponent>, returning the limit it is complete to
+
+uint64_t load_cached_factors(string & cache_filename, mpz_class & base, mpz_class & exponent, FactorList & factors) {
+    FactorCache cache;
+    if (!cache.open(cache_filename)) {
+        cout << "WARNING: couldn't open factor cache " << cache_filename << endl;
+        exit(1);
+    }
+    return cache.lookup(FactorCache::INDEX_ONE, base, exponent, UINT64_MAX, factors);
+}
+
+//descends the product tree of a batch of prime powers from node <index> of <level>, given <residue> =
+//base^exponent mod (base - 1) times that node, and collects the factors below it which do not divide
+
+void remainder_tree(vector<vector<mpz_class> > & tree, mpz_class & base_modulo, mpz_class & residue, size_t level, size_t index,
+                    FactorList & factors, size_t first, FactorList & non_dividing) {
+    if (residue == 1) return; //1 mod every divisor of the modulus too, so every factor below divides
+    if (level == 0) {
+        non_dividing.add(factors, first + index);
+        return;
+    }
+
+    vector<mpz_class> & below = tree[level - 1];
+    mpz_class modulo, child_residue;
+    for (size_t j = 2 * index; j < 2 * index + 2 && j < below.size(); ++j) {
+        modulo = base_modulo * below[j];
+        mpz_fdiv_r(child_residue.get_mpz_t(), residue.get_mpz_t(), modulo.get_mpz_t());
+        remainder_tree(tree, base_modulo, child_residue, level - 1, j, factors, first, non_dividing);
+    }
+}
+
+#define MIN_BATCH_BITS 256 //small moduli cost about the same up to a few words, so fill those at least
+
+//checks <count> of the <factors> starting at <first>: one exponentiation modulo (base - 1) times the product of
+//their prime powers, then a remainder tree down to each
+
+void check_batch(mpz_class & base, mpz_class & exponent, mpz_class & base_modulo, FactorList & factors, size_t first, size_t count,
+                 FactorList & non_dividing) {
+    vector<vector<mpz_class> > tree(1, vector<mpz_class>(count)); //level 0 is the prime powers, the last level their product
+    for (size_t i = 0; i < count; ++i) {
+        factors.primePower(first + i, tree[0][i]);
+    }
+    while (tree.back().size() > 1) {
+        vector<mpz_class> & below = tree.back();
+        vector<mpz_class> level((below.size() + 1) / 2);
+        for (size_t j = 0; j < level.size(); ++j) {
+            level[j] = 2 * j + 1 < below.size() ? below[2 * j] * below[2 * j + 1] : below[2 * j];
+        }
+        tree.push_back(level);
+    }
+
+    mpz_class modulo = base_modulo * tree.back()[0];
+    mpz_class residue;
+    mpz_powm(residue.get_mpz_t(), base.get_mpz_t(), exponent.get_mpz_t(), modulo.get_mpz_t());
+    remainder_tree(tree, base_modulo, residue, tree.size() - 1, 0, factors, first, non_dividing);
+}
+
+//collects in <non_dividing> the <factors> which do not divide (<base>^<exponent> - 1)/(<base> - 1), in order.
+//p^k divides it iff base^exponent = 1 mod (base - 1)*p^k. An exponentiation costs about the square of its
+//modulus size, so factors are checked in batches whose product is about as large as base - 1: all of them
+//then cost little more than one of them alone
+
+void find_non_dividing(mpz_class & base, mpz_class & exponent, FactorList & factors, FactorList & non_dividing) {
+    non_dividing.clear();
+    mpz_class base_modulo = base - 1;
+    size_t batch_bits = max(mpz_sizeinbase(base_modulo.get_mpz_t(), 2), (size_t) MIN_BATCH_BITS);
+
+    size_t first = 0, bits = 0;
+    for (size_t i = 0; i < factors.size(); ++i) {
+        bits += (factors.isWord(i) ? 64 - __builtin_clzll(factors.word(i) | 1) : mpz_sizeinbase(factors.prime(i).get_mpz_t(), 2)) * factors.multiplicity(i);
+        if (bits >= batch_bits || i + 1 == factors.size()) {
+            check_batch(base, exponent, base_modulo, factors, first, i + 1 - first, non_dividing);
+            first = i + 1;
+            bits = 0;
+        }
+    }
+}
+
+//returns the quoted string value of <key> in a JSON line
+
+bool json_string(const string & line, const string & key, string & value) {
+    string::size_type at = line.find("\"" + key + "\"");
+    if (at == string::npos) return false;
+    at = line.find('"', line.find(':', at) + 1);
+    string::size_type end = line.find('"', at + 1);
+    if (at == string::npos || end == string::npos) return false;
+    value = line.substr(at + 1, end - at - 1);
+    return true;
+}
+
+//parses a record: "<base> <exponent> (<factors>)" as logged by powerAbundance, "<base>^<exponent>: d = <factors> * remainder ..."
+//as written by powerTrialFactoring, or either tool's JSON line
+
+bool parse_record(const string & line, mpz_class & base, mpz_class & exponent, FactorList & factors) {
+    factors.clear();
+    string base_text, exponent_text;
+    if (line.find('{') != string::npos) {
+        if (!json_string(line, "base", base_text) || !json_string(line, "exponent", exponent_text)) return false;
+        string::size_type at = line.find("\"factors\"");
+        if (at == string::npos) return false;
+        string::size_type end = line.find("]]", at);
+        at = line.find('[', at);
+        while (at != string::npos && at < end) { //each factor is ["p", k]
+            string::size_type open = line.find("[\"", at);
+            if (open == string::npos || open > end) break;
+            string::size_type close = line.find('"', open + 2);
+            mpz_class factor;
+            if (close == string::npos || factor.set_str(line.substr(open + 2, close - open - 2), 10)) return false;
+            long long power = atoll(line.c_str() + line.find(',', close) + 1);
+            if (power < 1) return false;
+            factors.add(factor, power);
+            at = close;
+        }
+    } else if (line.find(':') != string::npos) {
+        string::size_type caret = line.find('^'), colon = line.find(':');
+        if (caret == string::npos || caret > colon) return false;
+        base_text = line.substr(0, caret);
+        exponent_text = line.substr(caret + 1, colon - caret - 1);
+        string::size_type d = line.find("d = ", colon);
+        if (d != string::npos && !factors.parse(line.substr(d + 4))) return false;
+    } else {
+        string::size_type space = line.find(' '), open = line.find('('), close = line.rfind(')');
+        if (space == string::npos || open == string::npos || close == string::npos || close < open) return false;
+        base_text = line.substr(0, space);
+        exponent_text = line.substr(space + 1, open - space - 1);
+        exponent_text.erase(exponent_text.find_last_not_of(' ') + 1);
+        if (!factors.parse(line.substr(open + 1, close - open - 1))) return false;
+    }
+    return !base.set_str(base_text, 10) && !exponent.set_str(exponent_text, 10) && base > 1 && exponent >= 0;
+}
+
+//verifies the record on line <line_number>, filling in <report>
+
+void verify_record(const string & line, uint64_t line_number, ResultRecord & report) {
+    FactorList factors;
+    report.layout = ResultRecord::VERIFICATION;
+    if (!parse_record(line, report.base, report.exponent, factors)) {
+        report.error = "line " + to_string(line_number) + ": cannot parse record";
+        return;
+    }
+    factors.merge();
+    if (!mpz_probab_prime_p(report.base.get_mpz_t(), 25)) {
+        report.error = "line " + to_string(line_number) + ": base " + report.base.get_str() + " is not prime";
+        return;
+    }
+
+    report.hasAbundance = true;
+    report.abundant = isAbundant(factors, report.abundance);
+
+    find_non_dividing(report.base, report.exponent, factors, report.factors);
+    report.passed = report.abundant && report.factors.empty();
 }
 
-//calculates <n>=product(<factors>) and <s>=sigma(<n>)
-
-void sigma(FactorVector & factors, mpz_class & s, mpz_class & n) {
-    mpz_class t, tmp, tmp2;
-    n = 1;
-    s = 1;
-    for (FactorVector::size_type j = 0; j < factors.size(); ++j) {
-        if (factors[j].second == 1) {
-            t = factors[j].first + 1;
-        } else {
-            t = 1;
-            mpz_pow_ui(tmp.get_mpz_t(), factors[j].first.get_mpz_t(), factors[j].second + 1);
-            tmp -= 1;
-            tmp2 = factors[j].first - 1;
-            mpz_divexact(t.get_mpz_t(), tmp.get_mpz_t(), tmp2.get_mpz_t());
+#define BATCH_BLOCK 4096 //records read and verified at a time, so memory stays bounded
+
+//a block of record lines shared by the verifying threads
+
+typedef struct {
+    vector<string> lines;
+    vector<uint64_t> line_numbers;
+    vector<ResultRecord> reports;
+    atomic<size_t> next;
+} VerifyBlock;
+
+void verify_block(VerifyBlock * block) {
+    size_t k;
+    while ((k = block->next++) < block->lines.size()) {
+        verify_record(block->lines[k], block->line_numbers[k], block->reports[k]);
+    }
+}
+
+//verifies every record of <input>, writing the reports in input order; returns the number that failed
+
+uint64_t verify_batch(istream & input, ResultWriter & report, unsigned long thread_count, uint64_t & total) {
+    VerifyBlock block;
+    uint64_t failed = 0, line_number = 0;
+    string line;
+    total = 0;
+    while (input) {
+        block.lines.clear();
+        block.line_numbers.clear();
+        while (block.lines.size() < BATCH_BLOCK && getline(input, line)) {
+            ++line_number;
+            if (line.find_first_not_of(" \t\r") == string::npos || line[0] == '#') continue;
+            block.lines.push_back(line);
+            block.line_numbers.push_back(line_number);
         }
+        block.reports.assign(block.lines.size(), ResultRecord());
+        block.next = 0;
 
-        s *= t;
+        vector<thread> threads;
+        for (unsigned long t = 0; t < thread_count; ++t) {
+            threads.push_back(thread(verify_block, &block));
+        }
+        for (vector<thread>::size_type t = 0; t < threads.size(); ++t) {
+            threads[t].join();
+        }
 
-        mpz_pow_ui(tmp.get_mpz_t(), factors[j].first.get_mpz_t(), factors[j].second);
-        n *= tmp;
+        for (vector<ResultRecord>::size_type k = 0; k < block.reports.size(); ++k) {
+            if (!block.reports[k].passed) failed++;
+            report.write(block.reports[k]);
+        }
+        total += block.reports.size();
     }
+    return failed;
 }
 
 void print_help() {
-    cout << "usage: verifyPrimePowerAbundance <base> <exponent>" << endl
-         << "Place partial factorization (one factor per line) in file 'partial_factors'" << endl;
+    cout << "usage: verifyPrimePowerAbundance <base> <exponent> [-f <cacheFile>]" << endl
+         << "       verifyPrimePowerAbundance -b <recordFile> [-t <threadCount>] [-o <reportFile>] [-j]" << endl
+         << "Place partial factorization (one factor per line) in file 'partial_factors'," << endl
+         << "or take it from a factor cache written by the other tools with -f" << endl
+         << "-b verifies every record of <recordFile> ('-' for standard input): powerAbundance log lines," << endl
+         << "   powerTrialFactoring result lines, or either as JSON lines. The report goes to standard output" << endl
+         << "   unless -o is given, as JSON lines with -j; the exit status is 3 if any record fails." << endl;
 }
 
 int main(int argc, char ** argv) {
-    if (argc < 3) {
+    const Arg_parser::Option options[] = {
+        { 'f', "factorCache", Arg_parser::yes },
+        { 'b', "batch",       Arg_parser::yes },
+        { 't', "threadCount", Arg_parser::yes },
+        { 'o', "output",      Arg_parser::yes },
+        { 'j', "json",        Arg_parser::no  },
+        {   0, 0,             Arg_parser::no  }
+    };
+
+    const Arg_parser parser(argc, argv, options);
+    if (parser.error().size()) {
+        cerr << "Argument error: " << parser.error() << endl;
+        return 1;
+    }
+
+    string cache_filename = "";
+    string batch_filename = "";
+    string report_filename = "-";
+    ResultWriter::Format report_format = ResultWriter::TEXT;
+    unsigned long thread_count = 1;
+    int argind;
+    for (argind = 0; argind < parser.arguments(); ++argind) {
+        const int code = parser.code(argind);
+        if (!code) break;
+        switch (code) {
+            case 'f': cache_filename = parser.argument(argind); break;
+            case 'b': batch_filename = parser.argument(argind); break;
+            case 't': thread_count = stol(parser.argument(argind)); break;
+            case 'o': report_filename = parser.argument(argind); break;
+            case 'j': report_format = ResultWriter::JSON_LINES; break;
+            default:
+                cerr << "Uncaught option: " << code << endl;
+        }
+    }
+
+    if (!batch_filename.empty()) {
+        ifstream batch_file;
+        if (batch_filename != "-") {
+            batch_file.open(batch_filename);
+            if (!batch_file.is_open()) {
+                cout << "WARNING: couldn't open input file for reading!" << endl;
+                return 1;
+            }
+        }
+        ResultWriter report;
+        if (!report.open(report_filename, report_format, 0, false)) {
+            cout << "WARNING: couldn't open output file for writing!" << endl;
+            return 1;
+        }
+        uint64_t total;
+        uint64_t failed = verify_batch(batch_filename == "-" ? cin : batch_file, report, thread_count, total);
+        if (!report.close()) {
+            cout << "WARNING: couldn't write output file!" << endl;
+            return 1;
+        }
+        cerr << "Verified " << total << " records: " << total - failed << " passed, " << failed << " failed" << endl;
+        return failed ? 3 : 0;
+    }
+
+    if (parser.arguments() - argind < 2) {
         print_help();
         return 1;
     }
 
-    mpz_class base;
-    base.set_str(argv[1], 10);
-    long exponent = atol(argv[2]);
+    mpz_class base, exponent;
+    base.set_str(parser.argument(argind), 10);
+    exponent.set_str(parser.argument(argind + 1), 10);
 
-    FactorVector factors; //vector<pair<p_i,x_i> >, n = product(p_i^x_i)
-    load_factors(factors);
+    FactorList factors; //n = product(p_i^x_i)
+    if (cache_filename.empty()) {
+        load_factors(factors);
+        factors.merge();
+    } else {
+        uint64_t limit = load_cached_factors(cache_filename, base, exponent, factors);
+        if (!limit) {
+            cout << "No cached factors of index 1 of " << base.get_str() << "^" << exponent << endl;
+            return 1;
+        }
+        cout << "Cached factors up to limit=" << limit << endl;
+    }
 
     // Validate abundance
-    mpz_class n, s, partial;
-    sigma(factors, s, partial); //calculate sigma(n) and partial = product(factors)
-    n = s - partial;
-    mpq_class abundance(n, partial);
-    if (n > partial) {
-        cout << "Index 1 of " << base.get_str() << "^" << exponent << " is abundant! (" << abundance.get_d() << ")" << endl;
+    double abundance;
+    if (isAbundant(factors, abundance)) {
+        cout << "Index 1 of " << base.get_str() << "^" << exponent << " is abundant! (" << abundance << ")" << endl;
     } else {
-        cout << "Index 1 of " << base.get_str() << "^" << exponent << " is not abundant. (" << abundance.get_d() << ")" << endl;
+        cout << "Index 1 of " << base.get_str() << "^" << exponent << " is not abundant. (" << abundance << ")" << endl;
     }
 
     // Validate divisibility
-    mpz_class base_modulo = base - 1;
-    mpz_class modulo;
-    mpz_class result;
-    bool allFactorsDivide = true;
-    for (FactorVector::size_type i = 0; i < factors.size(); ++i) {
-        mpz_class factor;
-        mpz_pow_ui(factor.get_mpz_t(), factors[i].first.get_mpz_t(), factors[i].second);
-        modulo = base_modulo * factor;
-        mpz_powm_ui(result.get_mpz_t(), base.get_mpz_t(), exponent, modulo.get_mpz_t());
-        if (mpz_cmp_ui(result.get_mpz_t(), 1)) {
-            if (factors[i].second > 1) {
-                cout << "Does not divide: " << factors[i].first.get_str() << "^" << factors[i].second << endl;
-            } else {
-                cout << "Does not divide: " << factor.get_str() << endl;
-            }
-            allFactorsDivide = false;
-        }
+    FactorList non_dividing;
+    find_non_dividing(base, exponent, factors, non_dividing);
+    for (size_t i = 0; i < non_dividing.size(); ++i) {
+        cout << "Does not divide: " << non_dividing.prime(i).get_str();
+        if (non_dividing.multiplicity(i) > 1) cout << "^" << non_dividing.multiplicity(i);
+        cout << endl;
     }
-    if (allFactorsDivide) {
+    if (non_dividing.empty()) {
         cout << "All factors divide!" << endl;
     }
     return 0;